@@ -4,13 +4,54 @@
 // IMPORTANT(Ryan): This is the only place where platform-specific can be included into
 // non-specific code
 
-int
-least_significant_bit_set(uint val)
+#include <x86intrin.h>
+
+inline u32
+least_significant_bit_set(u32 val)
 {
-  int result = 0;
+  u32 result = 0;
 
 #if defined(__GNUC__) || defined(__GNUG__)
-  result = __builtin_ctz();
+  result = __builtin_ctz(val);
+#endif
+
+  return result;
+}
+
+inline u64
+read_cpu_timer(void)
+{
+  u64 result = __rdtsc();
+
+  return result;
+}
+
+// NOTE(Ryan): Z-order curve. x goes into the even bits and y into the odd bits, so only the low
+// 16 bits of each are kept
+inline u32
+morton_spread_bits(u32 val)
+{
+  u32 result = val & 0x0000FFFF;
+
+  result = (result | (result << 8)) & 0x00FF00FF;
+  result = (result | (result << 4)) & 0x0F0F0F0F;
+  result = (result | (result << 2)) & 0x33333333;
+  result = (result | (result << 1)) & 0x55555555;
+
+  return result;
+}
+
+// IMPORTANT(Ryan): pdep is microcoded on AMD before Zen 3, where the shifts and masks 
+// of the fallback are much faster
+inline u32
+morton_encode(u32 x, u32 y)
+{
+  u32 result = 0;
+
+#if defined(__BMI2__)
+  result = _pdep_u32(x, 0x55555555) | _pdep_u32(y, 0xAAAAAAAA);
+#else
+  result = morton_spread_bits(x) | (morton_spread_bits(y) << 1);
 #endif
 
   return result;
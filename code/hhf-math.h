@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: zlib-acknowledgement
+#pragma once
+
+struct V2
+{
+  r32 x, y;
+};
+
+inline V2
+v2(r32 x, r32 y)
+{
+  V2 result = {x, y};
+
+  return result;
+}
+
+inline V2
+operator+(V2 a, V2 b)
+{
+  V2 result = {a.x + b.x, a.y + b.y};
+
+  return result;
+}
+
+inline V2
+operator-(V2 a, V2 b)
+{
+  V2 result = {a.x - b.x, a.y - b.y};
+
+  return result;
+}
+
+inline V2
+operator-(V2 a)
+{
+  V2 result = {-a.x, -a.y};
+
+  return result;
+}
+
+inline V2
+operator*(r32 s, V2 a)
+{
+  V2 result = {s * a.x, s * a.y};
+
+  return result;
+}
+
+inline V2
+operator*(V2 a, r32 s)
+{
+  V2 result = s * a;
+
+  return result;
+}
+
+inline V2 &
+operator+=(V2 &a, V2 b)
+{
+  a = a + b;
+
+  return a;
+}
+
+inline V2 &
+operator-=(V2 &a, V2 b)
+{
+  a = a - b;
+
+  return a;
+}
+
+inline V2 &
+operator*=(V2 &a, r32 s)
+{
+  a = s * a;
+
+  return a;
+}
+
+inline r32
+dot(V2 a, V2 b)
+{
+  r32 result = a.x * b.x + a.y * b.y;
+
+  return result;
+}
+
+inline r32
+length_sq(V2 a)
+{
+  r32 result = dot(a, a);
+
+  return result;
+}
+
+// NOTE(Ryan): Counter-clockwise 90 degrees
+inline V2
+perp(V2 a)
+{
+  V2 result = {-a.y, a.x};
+
+  return result;
+}
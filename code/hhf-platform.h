@@ -34,12 +34,32 @@ typedef struct HHFThreadContext
   int placeholder;
 } HHFThreadContext;
 
+// NOTE(Ryan): Pixel coordinates [min, max)
+typedef struct HHFRect
+{
+  int min_x, min_y;
+  int max_x, max_y;
+} HHFRect;
+
+#define HHF_BACK_BUFFER_MAX_DIRTY_RECTS 16
+// NOTE(Ryan): Largest the platform creates, so the game can reserve its copies of the back 
+// buffer once
+#define HHF_BACK_BUFFER_MAX_WIDTH 1920
+#define HHF_BACK_BUFFER_MAX_HEIGHT 1080
 typedef struct HHFBackBuffer
 {
   // NOTE(Ryan): Memory order: XX RR GG BB
   u8 *memory;
   int width;
   int height;
+
+  // NOTE(Ryan): Regions changed this frame, filled in by the game. 
+  // Only these are uploaded and presented by the platform
+  int num_dirty_rects;
+  HHFRect dirty_rects[HHF_BACK_BUFFER_MAX_DIRTY_RECTS];
+  // NOTE(Ryan): Set by the platform when memory no longer holds the previous frame, 
+  // e.g. game memory was restored for playback
+  bool needs_full_redraw;
 } HHFBackBuffer;
 
 typedef struct HHFSoundBuffer
@@ -94,9 +114,17 @@ typedef struct HHFInputController
 } HHFInputController;
 
 #define HHF_INPUT_MAX_NUM_CONTROLLERS 8
+// NOTE(Ryan): Simulation rate is independent of the display's refresh rate
+#define HHF_SIM_TICKS_PER_SECOND 60
+#define HHF_MAX_SIM_TICKS_PER_FRAME 8
+
 typedef struct HHFInput
 {
-  r32 frame_dt;
+  // NOTE(Ryan): Game runs num_sim_ticks steps of sim_dt, then renders render_alpha of the way 
+  // from the previous step to the latest
+  r32 sim_dt;
+  int num_sim_ticks;
+  r32 render_alpha;
 
   union
   {
@@ -113,6 +141,76 @@ typedef struct HHFInput
   HHFInputController controllers[HHF_INPUT_MAX_NUM_CONTROLLERS];
 } HHFInput;
 
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): Counters are in platform memory so they survive hot reloading
+enum DEBUG_CYCLE_COUNTER
+{
+  DEBUG_CYCLE_COUNTER_UPDATE_AND_RENDER = 0,
+  // NOTE(Ryan): Hits are pixels filled. The F2 checks also fill with a per pixel loop
+  DEBUG_CYCLE_COUNTER_DRAW_RECT,
+  DEBUG_CYCLE_COUNTER_DRAW_RECT_PER_PIXEL,
+  // NOTE(Ryan): Hits are pixels considered, so cycles/hit is cycles per pixel
+  DEBUG_CYCLE_COUNTER_DRAW_BMP,
+  // NOTE(Ryan): Hits are sprite pixels, for the stress scene blitted without then with spans
+  DEBUG_CYCLE_COUNTER_DRAW_BMP_PER_PIXEL,
+  DEBUG_CYCLE_COUNTER_DRAW_BMP_SPANS,
+  DEBUG_CYCLE_COUNTER_DRAW_BMP_QUAD,
+  DEBUG_CYCLE_COUNTER_RENDER_TILE_LAYER,
+  // NOTE(Ryan): Hits are renders, visiting every tile that could reach the buffer. The F2 
+  // checks render each layer both ways
+  DEBUG_CYCLE_COUNTER_RENDER_TILE_LAYER_PER_TILE,
+  // NOTE(Ryan): Hits are pixels copied
+  DEBUG_CYCLE_COUNTER_BLIT_TILE_LAYER,
+  // NOTE(Ryan): Hits are pixels. Straight sRGB, exact linear tables, then the game's scalar 
+  // and SIMD gamma 2 paths
+  DEBUG_CYCLE_COUNTER_BLEND_SRGB,
+  DEBUG_CYCLE_COUNTER_BLEND_LINEAR_EXACT,
+  DEBUG_CYCLE_COUNTER_BLEND_LINEAR,
+  DEBUG_CYCLE_COUNTER_BLEND_LINEAR_SIMD,
+  // NOTE(Ryan): Hits are entities in the sim region
+  DEBUG_CYCLE_COUNTER_SIMULATE_ENTITIES,
+  // NOTE(Ryan): Hits are entities built into the hash then each queried around
+  DEBUG_CYCLE_COUNTER_SPATIAL_HASH_1K,
+  DEBUG_CYCLE_COUNTER_SPATIAL_HASH_10K,
+  DEBUG_CYCLE_COUNTER_SPATIAL_HASH_100K,
+  // NOTE(Ryan): Hits are tiles reached
+  DEBUG_CYCLE_COUNTER_BUILD_FLOW_FIELD,
+  // NOTE(Ryan): Hits are positions, timed by the precision check on F3
+  DEBUG_CYCLE_COUNTER_RECANONICALISE,
+  DEBUG_CYCLE_COUNTER_SUBTRACT,
+  // NOTE(Ryan): Hits are positions, scalar then batch
+  DEBUG_CYCLE_COUNTER_RECANONICALISE_1M,
+  DEBUG_CYCLE_COUNTER_RECANONICALISE_4X_1M,
+  DEBUG_CYCLE_COUNTER_SUBTRACT_1M,
+  DEBUG_CYCLE_COUNTER_SUBTRACT_4X_1M,
+  // NOTE(Ryan): Hits are 3x3 tile neighbourhood queries
+  DEBUG_CYCLE_COUNTER_TILE_LAYOUT_ROW_MAJOR_COLUMNS,
+  DEBUG_CYCLE_COUNTER_TILE_LAYOUT_MORTON_COLUMNS,
+  DEBUG_CYCLE_COUNTER_TILE_LAYOUT_ROW_MAJOR_RANDOM,
+  DEBUG_CYCLE_COUNTER_TILE_LAYOUT_MORTON_RANDOM,
+  // NOTE(Ryan): Hits are glyphs. The F2 checks also draw text blending every glyph pixel
+  DEBUG_CYCLE_COUNTER_DRAW_TEXT,
+  DEBUG_CYCLE_COUNTER_DRAW_TEXT_PER_PIXEL,
+
+  DEBUG_CYCLE_COUNTER_COUNT,
+};
+
+typedef struct HHFDebugCycleCounter
+{
+  u64 cycle_count;
+  u64 hit_count;
+} HHFDebugCycleCounter;
+
+#define HHF_DEBUG_NUM_FRAME_MARKERS 120
+typedef struct HHFDebugFrameMarker
+{
+  r32 ms_per_frame;
+  // NOTE(Ryan): In samples per channel written since startup
+  u64 audio_play_cursor;
+  u64 audio_write_cursor;
+} HHFDebugFrameMarker;
+#endif
+
 typedef struct HHFMemory
 {
   bool is_initialized;
@@ -122,21 +220,82 @@ typedef struct HHFMemory
   u64 permanent_size;
   u8 *transient;
   u64 transient_size;
+
+  // NOTE(Ryan): Bumped by the platform whenever an asset file is rewritten
+  u32 asset_generation;
+
+#if defined(HHF_INTERNAL)
+  HHFDebugCycleCounter debug_cycle_counters[DEBUG_CYCLE_COUNTER_COUNT];
+  // NOTE(Ryan): Copied by the platform before the counters are zeroed, so holds the last frame
+  HHFDebugCycleCounter debug_prev_cycle_counters[DEBUG_CYCLE_COUNTER_COUNT];
+  // NOTE(Ryan): Time for the whole of the previous frame, set by the platform
+  r32 debug_ms_per_frame;
+  r32 debug_target_ms_per_frame;
+  // NOTE(Ryan): From the frame pacer. Missed frames are vblanks presented late, since startup
+  r32 debug_work_estimate_ms;
+  u32 debug_num_missed_frames;
+  // NOTE(Ryan): Ring of completed frames, debug_frame_marker_i is the oldest (next written)
+  HHFDebugFrameMarker debug_frame_markers[HHF_DEBUG_NUM_FRAME_MARKERS];
+  u32 debug_frame_marker_i;
+  // NOTE(Ryan): Toggled by the platform on F1
+  bool debug_overlay_is_visible;
+  // NOTE(Ryan): Toggled by the platform on F2. Whilst set, each frame checks the renderers 
+  // against simple reference versions and breaks on any pixel that differs
+  bool debug_checks_are_enabled;
+  // NOTE(Ryan): Set by the platform on F3 and cleared by the game once the benchmarks have run
+  bool debug_want_benchmarks;
+#endif
 } HHFMemory;
 
-typedef struct HHFPlatformReadFileResult
+typedef struct HHFPlatformFile
 {
-  void *contents;
+  int errno_code;
   u64 size;
+  // NOTE(Ryan): Only meaningful to the platform
+  s64 platform_handle;
+} HHFPlatformFile;
+
+typedef struct HHFPlatformMappedFile
+{
   int errno_code;
-} HHFPlatformReadFileResult;
+  void *memory;
+  u64 size;
+} HHFPlatformMappedFile;
+
+typedef enum HHF_IO_STATUS
+{
+  HHF_IO_STATUS_PENDING = 0,
+  HHF_IO_STATUS_COMPLETE,
+  HHF_IO_STATUS_FAILED,
+} HHF_IO_STATUS;
+
+// NOTE(Ryan): Completion is reported once by poll_io or wait_io, after which the request 
+// is retired and its id no longer valid
+typedef struct HHFPlatformIORequest
+{
+  u32 id;
+  int errno_code;
+} HHFPlatformIORequest;
 
-typedef HHFPlatformReadFileResult (*hhf_read_entire_file)(HHFThreadContext *thread, char *file_name);
 typedef struct HHFPlatform
 {
-  hhf_read_entire_file read_entire_file;
-  void (*free_read_file_result)(HHFThreadContext *thread, HHFPlatformReadFileResult *read_result);
-  int (*write_entire_file)(HHFThreadContext *thread, char *filename, void *memory, u64 size);
+  // NOTE(Ryan): Happens in the background and replaces the file atomically. Memory must stay 
+  // unchanged until poll_io or wait_io reports completion
+  HHFPlatformIORequest (*write_entire_file)(HHFThreadContext *thread, char *filename, 
+                                            void *memory, u64 size);
+
+  // NOTE(Ryan): Reads land directly in caller memory, which must stay valid until completion
+  HHFPlatformFile (*open_file)(HHFThreadContext *thread, char *file_name);
+  void (*close_file)(HHFThreadContext *thread, HHFPlatformFile *file);
+  HHFPlatformIORequest (*read_file_async)(HHFThreadContext *thread, HHFPlatformFile *file, 
+                                          u64 offset, u64 size, void *dest);
+  HHF_IO_STATUS (*poll_io)(HHFThreadContext *thread, HHFPlatformIORequest *request);
+  HHF_IO_STATUS (*wait_io)(HHFThreadContext *thread, HHFPlatformIORequest *request);
+
+  // NOTE(Ryan): Private copy-on-write mapping, so writes never reach the file. Pages are only
+  // read in when first touched
+  HHFPlatformMappedFile (*map_file)(HHFThreadContext *thread, char *file_name);
+  void (*unmap_file)(HHFThreadContext *thread, HHFPlatformMappedFile *mapped_file);
 } HHFPlatform;
 
 #if defined(__cplusplus) 
@@ -14,6 +14,9 @@ struct TileMapDifference
 struct TileChunk
 {
   u32 *tiles;
+
+  // NOTE(Ryan): Bumped on every write to this chunk's tiles
+  u32 generation;
 };
 
 struct TileChunkPosition
@@ -39,6 +42,9 @@ struct TileMap
   int num_tile_chunks_z;
 
   TileChunk *chunks;
+
+  // NOTE(Ryan): Bumped on every tile write so caches of tile data know to rebuild
+  u32 tile_generation;
 };
 
 struct World
@@ -63,6 +69,8 @@ struct MemoryArena
   u8 *base;
   size_t size;
   size_t used;
+  // NOTE(Ryan): High water mark, as temporary memory hides what a frame needed at most
+  size_t peak_used;
 };
 
 INTERNAL void
@@ -71,6 +79,7 @@ initialise_memory_arena(MemoryArena *arena, size_t size, void *mem)
   arena->base = (u8 *)mem;
   arena->size = size;
   arena->used = 0;
+  arena->peak_used = 0;
 }
 
 // NOTE(Ryan): Generally use #defines over globals for flexibility in debug code
@@ -87,15 +96,203 @@ obtain_mem(MemoryArena *arena, size_t size)
 
   result = (u8 *)arena->base + arena->used;
   arena->used += size;
+  if (arena->used > arena->peak_used) arena->peak_used = arena->used;
+
+  return result;
+}
+
+struct TemporaryMemory
+{
+  MemoryArena *arena;
+  size_t used;
+};
+
+INTERNAL TemporaryMemory
+begin_temporary_memory(MemoryArena *arena)
+{
+  TemporaryMemory result = {};
+
+  result.arena = arena;
+  result.used = arena->used;
 
   return result;
 }
 
+INTERNAL void
+end_temporary_memory(TemporaryMemory temp)
+{
+  ASSERT(temp.arena->used >= temp.used);
+  temp.arena->used = temp.used;
+}
+
+// NOTE(Ryan): Stays valid whilst other entities are removed and the dense arrays reshuffle.
+// A removed entity's handle no longer matches its slot's generation
+struct EntityHandle
+{
+  u32 slot;
+  u32 generation;
+};
+
+enum ENTITY_TYPE
+{
+  ENTITY_TYPE_NULL = 0,
+  ENTITY_TYPE_PLAYER,
+  ENTITY_TYPE_MONSTER,
+};
+
+#define MAX_ENTITIES 4096
+
+// NOTE(Ryan): Structure of arrays, packed densely in [0, count), so a pass streams through 
+// only the fields it reads. Positions are split by component for the same reason
+struct EntityStore
+{
+  u32 count;
+
+  u32 abs_tile_x[MAX_ENTITIES];
+  u32 abs_tile_y[MAX_ENTITIES];
+  u32 abs_tile_z[MAX_ENTITIES];
+  r32 x_offset[MAX_ENTITIES];
+  r32 y_offset[MAX_ENTITIES];
+  V2 velocity[MAX_ENTITIES];
+  V2 half_dim[MAX_ENTITIES];
+  u8 type[MAX_ENTITIES];
+
+  // NOTE(Ryan): Cold, only read when rendering
+  TileMapPosition prev_pos[MAX_ENTITIES];
+
+  u32 slot_of_index[MAX_ENTITIES];
+  u32 index_of_slot[MAX_ENTITIES];
+  u32 slot_generation[MAX_ENTITIES];
+  u32 num_slots_used;
+  u32 free_slots[MAX_ENTITIES];
+  u32 num_free_slots;
+};
+
+#define SIM_ENTITY_NONE 0xFFFFFFFF
+
+// NOTE(Ryan): Entities near the camera, positioned in metres from the origin tile's centre.
+// Small floats keep full precision, and the update loops never touch tile coordinates
+struct SimRegion
+{
+  TileMapPosition origin;
+  V2 half_extent;
+
+  u32 count;
+  u32 *entity_index;
+  u32 *abs_tile_z;
+  V2 *pos;
+  V2 *velocity;
+  V2 *half_dim;
+  u8 *type;
+};
+
+// NOTE(Ryan): Cells are groups of tiles, keyed on the same absolute tile coordinates as chunks
+#define SPATIAL_HASH_CELL_SHIFT 1
+
+// NOTE(Ryan): Rebuilt from scratch each tick with a counting sort, so entries for a bucket are
+// contiguous and there are no per cell lists to maintain. Positions are relative to origin
+struct SpatialHash
+{
+  TileMapPosition origin;
+  r32 tile_side;
+
+  u32 count;
+  V2 *pos;
+
+  u32 bucket_mask;
+  // NOTE(Ryan): Bucket b's entries are [bucket_start[b], bucket_start[b + 1])
+  u32 *bucket_start;
+  u32 *entries;
+  // NOTE(Ryan): Distinct cells can share a bucket, so entries keep their cell to filter on.
+  // Position and floor are copied in too, so a query only reads the bucket's entries
+  u32 *entry_cell_x;
+  u32 *entry_cell_y;
+  V2 *entry_pos;
+  u32 *entry_abs_tile_z;
+};
+
+#define FLOW_FIELD_CHUNKS_DIM 4
+#define FLOW_FIELD_MAX_TARGETS 4
+#define FLOW_FIELD_UNREACHABLE 0xFFFF
+
+enum FLOW_DIRECTION
+{
+  FLOW_DIRECTION_NONE = 0,
+  FLOW_DIRECTION_RIGHT,
+  FLOW_DIRECTION_UP,
+  FLOW_DIRECTION_LEFT,
+  FLOW_DIRECTION_DOWN,
+};
+
+// NOTE(Ryan): Steps to the nearest target and which neighbour to step to, for every tile in a
+// window of chunks around the first target, on every floor. Agents only read their own tile,
+// so any number can follow one field. Stored chunk by chunk, the same as the tile map
+struct FlowField
+{
+  bool is_valid;
+  u32 num_targets;
+  TileMapPosition targets[FLOW_FIELD_MAX_TARGETS];
+  u32 tile_generation;
+
+  s32 min_chunk_x;
+  s32 min_chunk_y;
+  s32 num_chunks_z;
+  u32 tiles_per_chunk;
+
+  u8 *tile_value;
+  u16 *distance;
+  u8 *direction;
+  u32 *queue;
+};
+
+enum BITMAP_SPAN_TYPE
+{
+  BITMAP_SPAN_TYPE_OPAQUE = 0,
+  BITMAP_SPAN_TYPE_BLEND,
+};
+
+struct BitmapSpan
+{
+  u16 x;
+  u16 len;
+  BITMAP_SPAN_TYPE type;
+};
+
 struct LoadedBitmap
 {
   int width;
   int height;
   u32 *pixels;
+
+  // NOTE(Ryan): Spans for pixel row y are spans[row_span_offsets[y]] up to 
+  // spans[row_span_offsets[y + 1]]. Fully transparent runs are not stored, so cost nothing to draw
+  u32 *row_span_offsets;
+  BitmapSpan *spans;
+};
+
+// NOTE(Ryan): Font sheets are a 16x6 grid of equal cells holding ASCII 32 to 127
+#define FONT_FIRST_CHAR ' '
+#define FONT_NUM_CHARS 96
+#define FONT_SHEET_COLUMNS 16
+#define FONT_SHEET_ROWS 6
+
+struct FontGlyph
+{
+  // NOTE(Ryan): Trimmed ink box within the glyph's cell, top-down
+  int offset_x, offset_y;
+  int width, height;
+  // NOTE(Ryan): First atlas row, counted from the top
+  int atlas_row;
+};
+
+// NOTE(Ryan): Glyphs are trimmed and stacked down a single column, so each owns whole atlas 
+// rows and blits through the bitmap's own spans without clipping to its neighbours
+struct LoadedFont
+{
+  int advance;
+  int line_height;
+  LoadedBitmap atlas;
+  FontGlyph glyphs[FONT_NUM_CHARS];
 };
 
 struct PlayerBitmap
@@ -108,15 +305,90 @@ struct PlayerBitmap
 
 struct State
 {
+  MemoryArena asset_arena;
+  u32 loaded_asset_generation;
   MemoryArena world_arena;
   World *world;
 
   LoadedBitmap backdrop;
   PlayerBitmap player_bitmaps[4];
+  LoadedFont debug_font;
   int player_facing_direction;
 
-  TileMapPosition player_pos;
+  EntityStore *entities;
+  EntityHandle player;
   TileMapPosition camera_pos;
+
+#if defined(HHF_INTERNAL)
+  r32 debug_sprite_stress_t;
+#endif
+};
+
+#define TEXT_BATCH_MAX_GLYPHS 16384
+
+struct TextBatchGlyph
+{
+  s16 x, y;
+  u8 glyph_i;
+};
+
+// NOTE(Ryan): Text for the frame, blitted together at the end as one dirty rect
+struct TextBatch
+{
+  u32 num_glyphs;
+  TextBatchGlyph glyphs[TEXT_BATCH_MAX_GLYPHS];
+  int min_x, min_y, max_x, max_y;
+};
+
+// NOTE(Ryan): A chunk's tiles that draw anything, merged into runs of the same value along x.
+// Each is tile_x | tile_y << 8 | (run length - 1) << 16 | tile_value << 24
+struct TileDrawList
+{
+  // NOTE(Ryan): Generation of the chunk when built plus one, so 0 is never built
+  u32 built_generation;
+  u32 num_runs;
+  u32 *runs;
+};
+
+struct TransientState
+{
+  bool is_initialised;
+  MemoryArena arena;
+
+  // NOTE(Ryan): Backdrop and tiles for the current room. Only rendered again when the camera 
+  // or tiles change, otherwise copied to the back buffer in one opaque blit
+  HHFBackBuffer tile_layer;
+  bool tile_layer_is_valid;
+  TileMapPosition tile_layer_camera_pos;
+  u32 tile_layer_tile_generation;
+  u32 tile_layer_asset_generation;
+  // NOTE(Ryan): One per tile chunk, built when the chunk is first seen
+  TileDrawList *tile_draw_lists;
+
+  FlowField flow_field;
+
+  // NOTE(Ryan): Must stay untouched whilst the platform writes it out
+  u8 *save_buffer;
+  u64 save_buffer_size;
+  bool is_saving;
+  HHFPlatformIORequest save_request;
+
+  TextBatch text_batch;
+
+  // NOTE(Ryan): Everywhere else the back buffer still matches the tile layer
+  int num_prev_dynamic_rects;
+  HHFRect prev_dynamic_rects[HHF_BACK_BUFFER_MAX_DIRTY_RECTS];
+
+#if defined(HHF_INTERNAL)
+  // NOTE(Ryan): Scratch for the F2 checks. Kept rather than temporary, as rendering a tile 
+  // layer into them can build draw lists in the arena. Sized to the back buffer each frame
+  HHFBackBuffer debug_check_buffers[2];
+  u32 debug_check_i;
+  // NOTE(Ryan): Counts from the last F3 run, as the benchmarks only run on that one frame
+  HHFDebugCycleCounter debug_benchmark_counters[DEBUG_CYCLE_COUNTER_COUNT];
+  u32 debug_num_precision_checks;
+  u32 debug_num_precision_failures;
+#endif
 };
 
 #if 0
@@ -167,6 +439,42 @@ output_sound(HHFSoundBuffer *sound_buffer, HHFState *state)
 }
 #endif
 
+INTERNAL void
+add_dirty_rect(HHFBackBuffer *buffer, int min_x, int min_y, int max_x, int max_y)
+{
+  if (min_x < 0) min_x = 0;
+  if (min_y < 0) min_y = 0;
+  if (max_x > buffer->width) max_x = buffer->width;
+  if (max_y > buffer->height) max_y = buffer->height;
+  if (min_x >= max_x || min_y >= max_y) return;
+
+  HHFRect rect = {min_x, min_y, max_x, max_y};
+  if (buffer->num_dirty_rects < HHF_BACK_BUFFER_MAX_DIRTY_RECTS)
+  {
+    buffer->dirty_rects[buffer->num_dirty_rects++] = rect;
+  }
+  else
+  {
+    // NOTE(Ryan): Out of rects, so grow the last to cover. Over-reporting is always safe
+    HHFRect *last = &buffer->dirty_rects[HHF_BACK_BUFFER_MAX_DIRTY_RECTS - 1];
+    if (rect.min_x < last->min_x) last->min_x = rect.min_x;
+    if (rect.min_y < last->min_y) last->min_y = rect.min_y;
+    if (rect.max_x > last->max_x) last->max_x = rect.max_x;
+    if (rect.max_y > last->max_y) last->max_y = rect.max_y;
+  }
+}
+
+INTERNAL void
+copy_rect(HHFBackBuffer *dest, HHFBackBuffer *src, HHFRect *rect)
+{
+  int row_bytes = (rect->max_x - rect->min_x) * sizeof(u32);
+  for (int y = rect->min_y; y < rect->max_y; ++y)
+  {
+    memcpy((u32 *)dest->memory + (y * dest->width) + rect->min_x,
+           (u32 *)src->memory + (y * src->width) + rect->min_x, row_bytes);
+  }
+}
+
 // TODO(Ryan): Why are coordinates in floats? 
 // Allows sub-pixel positioning of sprites via interpolation?
 // What is sub-pixel? It makes movement smoother
@@ -190,21 +498,104 @@ draw_rect(HHFBackBuffer *back_buffer, r32 x0, r32 y0, r32 x1, r32 y1, r32 r, r32
   if (max_y < 0) max_y = 0;
   if (max_y >= back_buffer->height) max_y = back_buffer->height;
 
+  BEGIN_TIMED_BLOCK(DRAW_RECT);
+
   u32 colour = (u32)roundf(r * 255.0f) << 16 | 
                (u32)roundf(g * 255.0f) << 8 | 
                (u32)roundf(b * 255.0f);
+  __m128i colour_4x = _mm_set1_epi32((s32)colour);
 
+  int width = max_x - min_x;
+  int height = max_y - min_y;
+  int pitch = back_buffer->width * sizeof(u32);
+  u8 *row = (u8 *)back_buffer->memory + (min_y * pitch) + (min_x * sizeof(u32));
   for (int y = min_y; y < max_y; ++y)
   {
-    for (int x = min_x; x < max_x; ++x)
+    u32 *pixel = (u32 *)row;
+    int x = 0;
+    // NOTE(Ryan): Single pixels up to a 16 byte boundary, so the wide stores are aligned
+    for (; x < width && ((uintptr_t)(pixel + x) & 15) != 0; ++x)
     {
-      u32 *pixel = (u32 *)back_buffer->memory + x + (y * back_buffer->width);
-      *pixel = colour;
+      pixel[x] = colour;
+    }
+    // NOTE(Ryan): Unrolled so loop overhead doesn't hold back the stores on wide rows
+    for (; x + 16 <= width; x += 16)
+    {
+      _mm_store_si128((__m128i *)(pixel + x), colour_4x);
+      _mm_store_si128((__m128i *)(pixel + x + 4), colour_4x);
+      _mm_store_si128((__m128i *)(pixel + x + 8), colour_4x);
+      _mm_store_si128((__m128i *)(pixel + x + 12), colour_4x);
+    }
+    for (; x + 4 <= width; x += 4)
+    {
+      _mm_store_si128((__m128i *)(pixel + x), colour_4x);
     }
+    for (; x < width; ++x)
+    {
+      pixel[x] = colour;
+    }
+
+    row += pitch;
   }
 
+  add_dirty_rect(back_buffer, min_x, min_y, max_x, max_y);
+
+  END_TIMED_BLOCK_COUNTED(DRAW_RECT, (width > 0 && height > 0) ? width * height : 0);
+}
+
+
+// NOTE(Ryan): Building with HHF_MORTON_LAYOUT stores the chunk table of each floor and the tiles
+// of each chunk in Z-order, so a tile's vertical neighbours are usually near it in memory rather
+// than a whole row away. Z-order chunk indices need a square, power of two chunk table
+INTERNAL bool
+is_chunk_table_layout_valid(s32 num_tile_chunks_x, s32 num_tile_chunks_y)
+{
+  bool result = (num_tile_chunks_x > 0 && num_tile_chunks_y > 0);
+
+#if defined(HHF_MORTON_LAYOUT)
+  result = result && (num_tile_chunks_x == num_tile_chunks_y) && 
+           ((num_tile_chunks_x & (num_tile_chunks_x - 1)) == 0);
+#endif
+
+  return result;
+}
+
+INTERNAL u32
+get_num_tile_chunks(TileMap *tile_map)
+{
+  u32 result = tile_map->num_tile_chunks_x * tile_map->num_tile_chunks_y * 
+               tile_map->num_tile_chunks_z;
+
+  return result;
+}
+
+INTERNAL u32
+get_tile_chunk_index(TileMap *tile_map, u32 tile_chunk_x, u32 tile_chunk_y, u32 tile_chunk_z)
+{
+  u32 result = tile_chunk_z * tile_map->num_tile_chunks_y * tile_map->num_tile_chunks_x;
+
+#if defined(HHF_MORTON_LAYOUT)
+  result += morton_encode(tile_chunk_x, tile_chunk_y);
+#else
+  result += tile_chunk_y * tile_map->num_tile_chunks_x + tile_chunk_x;
+#endif
+
+  return result;
 }
 
+INTERNAL u32
+get_tile_index(TileMap *tile_map, u32 tile_x, u32 tile_y)
+{
+  u32 result = 0;
+
+#if defined(HHF_MORTON_LAYOUT)
+  result = morton_encode(tile_x, tile_y);
+#else
+  result = tile_y * tile_map->chunk_dim + tile_x;
+#endif
+
+  return result;
+}
 
 INTERNAL TileChunk *
 get_tile_chunk(TileMap *tile_map, int tile_chunk_x, int tile_chunk_y, int tile_chunk_z)
@@ -215,23 +606,39 @@ get_tile_chunk(TileMap *tile_map, int tile_chunk_x, int tile_chunk_y, int tile_c
       tile_chunk_y >=0 && tile_chunk_y < tile_map->num_tile_chunks_y &&
       tile_chunk_z >=0 && tile_chunk_z < tile_map->num_tile_chunks_z)
   {
-    result = &tile_map->chunks[
-               tile_chunk_z * tile_map->num_tile_chunks_y * tile_map->num_tile_chunks_x + 
-               tile_chunk_y * tile_map->num_tile_chunks_x + 
-               tile_chunk_x];
+    result = &tile_map->chunks[get_tile_chunk_index(tile_map, tile_chunk_x, tile_chunk_y, 
+                                                    tile_chunk_z)];
   }
 
   return result;
 }
 
+// NOTE(Ryan): Canonical offsets are within half a tile of the tile centre. Tile coordinates are
+// unsigned, so stepping past either end of the u32 range wraps to the other end. Chunk lookups
+// treat those tiles as outside the map, i.e. solid
 INTERNAL void
 recanonicalise_coord(TileMap *tile_map, u32 *tile_coord, r32 *tile_rel)
 {
+  r32 tile_side = tile_map->tile_side_in_metres;
+  r32 half_tile_side = 0.5f * tile_side;
+
   // IMPORTANT(Ryan): floor if storing offset from corner, round as offset from centre
-  int offset = (int)roundf(*tile_rel / tile_map->tile_side_in_metres);
-  *tile_coord += offset;
-  // TODO(Ryan): If tile_rel is a very small negative, we will wrap back 
-  *tile_rel -= (offset * tile_map->tile_side_in_metres);
+  s32 offset = (s32)roundf(*tile_rel / tile_side);
+  *tile_coord += (u32)offset;
+  *tile_rel -= (r32)offset * tile_side;
+
+  // NOTE(Ryan): The division and subtraction both round, so a value a hair from the tile edge
+  // can come out just past it. One more step brings it back
+  if (*tile_rel > half_tile_side)
+  {
+    *tile_coord += 1;
+    *tile_rel -= tile_side;
+  }
+  else if (*tile_rel < -half_tile_side)
+  {
+    *tile_coord -= 1;
+    *tile_rel += tile_side;
+  }
 }
 
 INTERNAL void
@@ -260,7 +667,7 @@ get_tile_value_unchecked(TileMap *tile_map, TileChunk *tile_chunk, u32 tile_x, u
 {
   u32 result = 0;
 
-  result = tile_chunk->tiles[tile_y * tile_map->chunk_dim + tile_x];
+  result = tile_chunk->tiles[get_tile_index(tile_map, tile_x, tile_y)];
 
   return result;
 }
@@ -322,21 +729,22 @@ are_on_same_tile(TileMapPosition *pos1, TileMapPosition *pos2)
 }
  
 INTERNAL bool
-is_tile_map_point_empty(TileMap *tile_map, TileMapPosition *pos)
+are_same_position(TileMapPosition *pos1, TileMapPosition *pos2)
 {
   bool result = false;
 
-  u32 tile_value = get_tile_value(tile_map, pos->abs_tile_x, pos->abs_tile_y, pos->abs_tile_z);
-  result = (tile_value == 1 || tile_value == 3 || tile_value == 4);
+  result = (are_on_same_tile(pos1, pos2) && 
+            pos1->x_offset == pos2->x_offset && pos1->y_offset == pos2->y_offset);
 
   return result;
 }
 
-
 INTERNAL void
 set_tile_value(TileMap *tile_map, TileChunk *tile_chunk, int tile_x, int tile_y, u32 value)
 {
-  tile_chunk->tiles[tile_map->chunk_dim * tile_y + tile_x] = value;
+  tile_chunk->tiles[get_tile_index(tile_map, tile_x, tile_y)] = value;
+  tile_chunk->generation++;
+  tile_map->tile_generation++;
 }
 
 INTERNAL void
@@ -368,11 +776,12 @@ subtract(TileMap *tile_map, TileMapPosition *pos1, TileMapPosition *pos2)
 {
   TileMapDifference result = {};
 
-  // IMPORTANT(Ryan): Best to use explicit casts when working with floating point to handle
-  // cases where working with unsigned may wrap around
-  r32 dtile_x = (r32)pos1->abs_tile_x - (r32)pos2->abs_tile_x;  
-  r32 dtile_y = (r32)pos1->abs_tile_y - (r32)pos2->abs_tile_y;  
-  r32 dtile_z = (r32)pos1->abs_tile_z - (r32)pos2->abs_tile_z;  
+  // IMPORTANT(Ryan): Subtract tiles as integers, then convert. Converting each u32 first loses 
+  // whole tiles past 2^24, whereas the difference is exact whenever it is under 2^24 tiles. 
+  // Wrapping subtraction read as signed also gives the short way across the u32 edge
+  r32 dtile_x = (r32)(s32)(pos1->abs_tile_x - pos2->abs_tile_x);  
+  r32 dtile_y = (r32)(s32)(pos1->abs_tile_y - pos2->abs_tile_y);  
+  r32 dtile_z = (r32)(s32)(pos1->abs_tile_z - pos2->abs_tile_z);  
 
   result.dx = tile_map->tile_side_in_metres * dtile_x + (pos1->x_offset - pos2->x_offset);
   result.dy = tile_map->tile_side_in_metres * dtile_y + (pos1->y_offset - pos2->y_offset);
@@ -381,311 +790,3831 @@ subtract(TileMap *tile_map, TileMapPosition *pos1, TileMapPosition *pos2)
   return result;
 }
 
-
-struct BitmapHeader
+// NOTE(Ryan): SoA batch versions working on one axis, 4 lanes at a time with a scalar tail.
+// Lane results match the scalar versions, except at an exact half tile where rounding to even 
+// may keep the tile that roundf steps off. Both are canonical
+INTERNAL void
+recanonicalise_coords_4x(TileMap *tile_map, u32 count, u32 *tile_coords, r32 *tile_rels)
 {
-  // TODO(Ryan): Will pack to largest size in struct?
-  u16 signature;
-  u32 file_size;
-  u32 reserved;
-  u32 data_offset;
-  u32 size;
-  u32 width;
-  u32 height;
-  u16 planes;
-  u16 bits_per_pixel;
-  u32 compression;
-  u32 size_of_bitmap;
-  u32 horz_resolution;
-  u32 vert_resolution;
-  u32 colors_used;
-  u32 colors_important;
-
-  u32 red_mask;
-  u32 green_mask;
-  u32 blue_mask;
-} __attribute__((packed));
+  r32 tile_side = tile_map->tile_side_in_metres;
+  __m128 tile_side_4x = _mm_set1_ps(tile_side);
+  __m128 inv_tile_side_4x = _mm_set1_ps(1.0f / tile_side);
+  __m128 half_tile_side_4x = _mm_set1_ps(0.5f * tile_side);
+  __m128 neg_half_tile_side_4x = _mm_set1_ps(-0.5f * tile_side);
+
+  u32 coord_i = 0;
+  for (; coord_i + 4 <= count; coord_i += 4)
+  {
+    __m128i tile = _mm_loadu_si128((__m128i *)(tile_coords + coord_i));
+    __m128 rel = _mm_loadu_ps(tile_rels + coord_i);
+
+    __m128i offset = _mm_cvtps_epi32(_mm_mul_ps(rel, inv_tile_side_4x));
+    tile = _mm_add_epi32(tile, offset);
+    rel = _mm_sub_ps(rel, _mm_mul_ps(_mm_cvtepi32_ps(offset), tile_side_4x));
+
+    // NOTE(Ryan): The reciprocal can leave a lane just past the tile edge. Comparison masks are 
+    // -1 per lane, so subtracting the mask carries one tile up
+    __m128 over = _mm_cmpgt_ps(rel, half_tile_side_4x);
+    __m128 under = _mm_cmplt_ps(rel, neg_half_tile_side_4x);
+    tile = _mm_sub_epi32(tile, _mm_castps_si128(over));
+    tile = _mm_add_epi32(tile, _mm_castps_si128(under));
+    rel = _mm_sub_ps(rel, _mm_and_ps(over, tile_side_4x));
+    rel = _mm_add_ps(rel, _mm_and_ps(under, tile_side_4x));
+
+    _mm_storeu_si128((__m128i *)(tile_coords + coord_i), tile);
+    _mm_storeu_ps(tile_rels + coord_i, rel);
+  }
 
+  for (; coord_i < count; ++coord_i)
+  {
+    recanonicalise_coord(tile_map, &tile_coords[coord_i], &tile_rels[coord_i]);
+  }
+}
 
+// NOTE(Ryan): Distance of each coordinate from a single origin coordinate
 INTERNAL void
-draw_bmp(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap, r32 x, r32 y,
-         int align_x = 0, int align_y = 0)
+subtract_coords_4x(TileMap *tile_map, u32 count, u32 *tile_coords, r32 *tile_rels, 
+                   u32 origin_tile_coord, r32 origin_tile_rel, r32 *result)
 {
-  x -= (r32)align_x;
-  y -= (r32)align_y;
-
-  int min_x = (u32)roundf(x);
-  int max_x = (u32)roundf(x + bitmap->width);
-  int min_y = (u32)roundf(y);
-  int max_y = (u32)roundf(y + bitmap->height);
+  r32 tile_side = tile_map->tile_side_in_metres;
+  __m128 tile_side_4x = _mm_set1_ps(tile_side);
+  __m128i origin_tile_coord_4x = _mm_set1_epi32((s32)origin_tile_coord);
+  __m128 origin_tile_rel_4x = _mm_set1_ps(origin_tile_rel);
 
-  int offset_x = 0;
-  if (min_x < 0) 
+  u32 coord_i = 0;
+  for (; coord_i + 4 <= count; coord_i += 4)
   {
-    offset_x = -min_x;
-    min_x = 0;
+    __m128i tile = _mm_loadu_si128((__m128i *)(tile_coords + coord_i));
+    __m128 rel = _mm_loadu_ps(tile_rels + coord_i);
+
+    // NOTE(Ryan): Wrapping integer subtract converted as signed, as the scalar version does
+    __m128 dtile = _mm_cvtepi32_ps(_mm_sub_epi32(tile, origin_tile_coord_4x));
+    __m128 diff = _mm_add_ps(_mm_mul_ps(tile_side_4x, dtile), 
+                             _mm_sub_ps(rel, origin_tile_rel_4x));
+
+    _mm_storeu_ps(result + coord_i, diff);
   }
-  int offset_y = 0;
-  if (min_y < 0) 
+
+  for (; coord_i < count; ++coord_i)
   {
-    offset_y = -min_y;
-    min_y = 0;
+    r32 dtile = (r32)(s32)(tile_coords[coord_i] - origin_tile_coord);
+    result[coord_i] = tile_side * dtile + (tile_rels[coord_i] - origin_tile_rel);
   }
+}
 
-  if (max_x > back_buffer->width) max_x = back_buffer->width;
-  if (max_y > back_buffer->height) max_y = back_buffer->height;
 
-  u32 *bitmap_row = (u32 *)bitmap->pixels + (bitmap->width * (bitmap->height - 1));
-  bitmap_row += -(bitmap->width * offset_y) + offset_x;
-  u32 *buffer_row = (u32 *)back_buffer->memory + (back_buffer->width * min_y + min_x);
-  for (int y = min_y; y < max_y; ++y)
-  {
-    u32 *buffer_cursor = buffer_row;
-    u32 *pixel_cursor = bitmap_row;
+#if defined(HHF_INTERNAL)
+INTERNAL u32
+debug_random_u32(u32 *random_state)
+{
+  *random_state ^= *random_state << 13;
+  *random_state ^= *random_state >> 17;
+  *random_state ^= *random_state << 5;
 
-    for (int x = min_x; x < max_x; ++x)
-    {
-      // TODO(Ryan): Gamma refers to monitor/graphics card further altering our values to increase their brightness?
-      // NOTE(Ryan): 1. Alpha test has a cut-off threshold
-      // 2. Alpha linear blend with background
-      r32 alpha_blend_t = (*pixel_cursor >> 24 & 0xFF) / 255.0f;
-      
-      r32 red_orig = (*buffer_cursor >> 16 & 0xFF);
-      r32 new_red = (*pixel_cursor >> 16 & 0xFF);
-      r32 red_blended = red_orig + alpha_blend_t * (new_red - red_orig);
+  return *random_state;
+}
+
+INTERNAL r32
+debug_random_bilateral(u32 *random_state)
+{
+  r32 result = ((r32)(debug_random_u32(random_state) >> 8) / (r32)(1 << 23)) - 1.0f;
 
-      r32 green_orig = (*buffer_cursor >> 8 & 0xFF);
-      r32 new_green = (*pixel_cursor >> 8 & 0xFF);
-      r32 green_blended = green_orig + alpha_blend_t * (new_green - green_orig);
+  return result;
+}
 
-      r32 blue_orig = (*buffer_cursor >> 0 & 0xFF);
-      r32 new_blue = (*pixel_cursor >> 0 & 0xFF);
-      r32 blue_blended = blue_orig + alpha_blend_t * (new_blue - blue_orig);
+// NOTE(Ryan): Randomised positions across the whole u32 tile range, plus the edge cases of 
+// offsets a few ulps either side of half a tile and tiny negatives. Errors are measured 
+// against r64 arithmetic. Inputs are generated up front, so cycle counts are per position 
+// of just the calls under test. Returns the number of positions that failed
+INTERNAL u32
+debug_check_position_precision(MemoryArena *arena, TileMap *tile_map, u32 *num_checks)
+{
+  u32 random_state = 0x2545F491;
+  r32 tile_side = tile_map->tile_side_in_metres;
+  r32 half_tile_side = 0.5f * tile_side;
+  u32 num_failures = 0;
+
+  u32 num_positions = 1 << 16;
+  TemporaryMemory check_memory = begin_temporary_memory(arena);
+  TileMapPosition *positions = MEMORY_RESERVE_ARRAY(arena, num_positions, TileMapPosition);
+  TileMapPosition *canonicals = MEMORY_RESERVE_ARRAY(arena, num_positions, TileMapPosition);
+  for (u32 position_i = 0; position_i < num_positions; ++position_i)
+  {
+    TileMapPosition *pos = &positions[position_i];
+    *pos = {};
+    pos->abs_tile_x = debug_random_u32(&random_state);
+    pos->abs_tile_y = debug_random_u32(&random_state);
 
-      *buffer_cursor = 0xff << 24 | (u32)roundf(red_blended) << 16 | 
-                         (u32)roundf(green_blended) << 8 | 
-                         (u32)roundf(blue_blended) << 0; 
-      pixel_cursor++;
-      buffer_cursor++;
+    switch (position_i & 3)
+    {
+      case 0:
+      {
+        pos->x_offset = 4.0f * tile_side * debug_random_bilateral(&random_state);
+        pos->y_offset = 4.0f * tile_side * debug_random_bilateral(&random_state);
+      } break;
+      case 1:
+      {
+        // NOTE(Ryan): Within a few ulps of a tile edge up to 4 tiles away
+        int edge = (int)(debug_random_u32(&random_state) % 8) - 4;
+        int ulps = (int)(debug_random_u32(&random_state) % 17) - 8;
+        r32 towards = (ulps < 0) ? -1e9f : 1e9f;
+        pos->x_offset = ((r32)edge + 0.5f) * tile_side;
+        for (int ulp_i = 0; ulp_i < (ulps < 0 ? -ulps : ulps); ++ulp_i)
+        {
+          pos->x_offset = nextafterf(pos->x_offset, towards);
+        }
+        pos->y_offset = -pos->x_offset;
+      } break;
+      case 2:
+      {
+        pos->x_offset = -1e-30f;
+        pos->y_offset = -nextafterf(0.0f, 1.0f);
+      } break;
+      case 3:
+      {
+        // NOTE(Ryan): One step of a fast entity, as the simulation produces
+        pos->x_offset = half_tile_side * debug_random_bilateral(&random_state) + 0.2f;
+        pos->y_offset = half_tile_side * debug_random_bilateral(&random_state) - 0.2f;
+      } break;
     }
+  }
 
-    buffer_row += back_buffer->width;
-    bitmap_row -= bitmap->width;
+  memcpy(canonicals, positions, num_positions * sizeof(TileMapPosition));
+  BEGIN_TIMED_BLOCK(RECANONICALISE);
+  for (u32 position_i = 0; position_i < num_positions; ++position_i)
+  {
+    recanonicalise_position(tile_map, &canonicals[position_i]);
   }
-}
+  END_TIMED_BLOCK_COUNTED(RECANONICALISE, num_positions);
 
-// TODO(Ryan): PNG RLE may not help us as our graphics are painterly?
-INTERNAL LoadedBitmap 
-load_bmp(HHFThreadContext *thread, hhf_read_entire_file read_entire_file, char *filename)
-{
-  LoadedBitmap result = {};
-
-  HHFPlatformReadFileResult read_result = read_entire_file(thread, filename);
-  if (read_result.errno_code == 0)
-  {
-    BitmapHeader *bitmap_header = (BitmapHeader *)read_result.contents;
-    result.pixels = (u32 *)((u8 *)bitmap_header + bitmap_header->data_offset);
-
-    // IMPORTANT(Ryan): BMPs can go top-down and have compression. This just handles
-    // BMPs we create
-    u32 red_mask = bitmap_header->red_mask;
-    u32 green_mask = bitmap_header->green_mask;
-    u32 blue_mask = bitmap_header->blue_mask;
-    u32 alpha_mask = ~(red_mask | green_mask | blue_mask);
-
-    u32 red_shift = __builtin_ctz(red_mask);
-    u32 green_shift = __builtin_ctz(green_mask);
-    u32 blue_shift = __builtin_ctz(blue_mask);
-    u32 alpha_shift = __builtin_ctz(alpha_mask);
-    
-    // NOTE(Ryan): We determined bottom-up and byte order with structured art
-    u32 *pixels = result.pixels;
-    for (uint y = 0; y < bitmap_header->height; ++y)
-    {
-      for (uint x = 0; x < bitmap_header->width; ++x)
-      {
-        // NOTE(Ryan): This reordering is also known as swizzling
-        *pixels = (((*pixels >> alpha_shift) & 0xFF) << 24) |
-                  (((*pixels >> red_shift) & 0xFF) << 16) |
-                  (((*pixels >> green_shift) & 0xFF) << 8) |
-                  (((*pixels >> blue_shift) & 0xFF) << 0);
-        pixels++;
-      }
+  for (u32 position_i = 0; position_i < num_positions; ++position_i)
+  {
+    TileMapPosition *pos = &positions[position_i];
+    TileMapPosition *canonical = &canonicals[position_i];
+    r64 moved_x = (r64)(s32)(canonical->abs_tile_x - pos->abs_tile_x) * tile_side + 
+                  canonical->x_offset;
+    r64 moved_y = (r64)(s32)(canonical->abs_tile_y - pos->abs_tile_y) * tile_side + 
+                  canonical->y_offset;
+    if (fabsf(canonical->x_offset) > half_tile_side || 
+        fabsf(canonical->y_offset) > half_tile_side ||
+        fabs(moved_x - pos->x_offset) > 1e-6 || fabs(moved_y - pos->y_offset) > 1e-6)
+    {
+      num_failures += 1;
     }
+  }
 
-    result.width = bitmap_header->width;
-    result.height = bitmap_header->height;
+  // NOTE(Ryan): positions and canonicals are reused as the pairs to subtract
+  TileMapPosition *pos1s = positions;
+  TileMapPosition *pos2s = canonicals;
+  TileMapDifference *diffs = MEMORY_RESERVE_ARRAY(arena, num_positions, TileMapDifference);
+  for (u32 position_i = 0; position_i < num_positions; ++position_i)
+  {
+    TileMapPosition *pos1 = &pos1s[position_i];
+    *pos1 = {};
+    pos1->abs_tile_x = debug_random_u32(&random_state);
+    pos1->abs_tile_y = debug_random_u32(&random_state);
+    pos1->abs_tile_z = debug_random_u32(&random_state) & 1;
+    pos1->x_offset = half_tile_side * debug_random_bilateral(&random_state);
+    pos1->y_offset = half_tile_side * debug_random_bilateral(&random_state);
+
+    // NOTE(Ryan): Up to 2^20 tiles apart, wrapping across the u32 edge as it may
+    s32 dtile_x = (s32)(debug_random_u32(&random_state) >> 11) - (1 << 20);
+    s32 dtile_y = (s32)(debug_random_u32(&random_state) >> 11) - (1 << 20);
+    TileMapPosition *pos2 = &pos2s[position_i];
+    *pos2 = *pos1;
+    pos2->abs_tile_x -= (u32)dtile_x;
+    pos2->abs_tile_y -= (u32)dtile_y;
+    pos2->x_offset = half_tile_side * debug_random_bilateral(&random_state);
+    pos2->y_offset = half_tile_side * debug_random_bilateral(&random_state);
   }
 
-  return result;
+  BEGIN_TIMED_BLOCK(SUBTRACT);
+  for (u32 position_i = 0; position_i < num_positions; ++position_i)
+  {
+    diffs[position_i] = subtract(tile_map, &pos1s[position_i], &pos2s[position_i]);
+  }
+  END_TIMED_BLOCK_COUNTED(SUBTRACT, num_positions);
+
+  for (u32 position_i = 0; position_i < num_positions; ++position_i)
+  {
+    TileMapPosition *pos1 = &pos1s[position_i];
+    TileMapPosition *pos2 = &pos2s[position_i];
+    TileMapDifference *diff = &diffs[position_i];
+    s32 dtile_x = (s32)(pos1->abs_tile_x - pos2->abs_tile_x);
+    s32 dtile_y = (s32)(pos1->abs_tile_y - pos2->abs_tile_y);
+    r64 expected_dx = (r64)dtile_x * tile_side + ((r64)pos1->x_offset - pos2->x_offset);
+    r64 expected_dy = (r64)dtile_y * tile_side + ((r64)pos1->y_offset - pos2->y_offset);
+    // NOTE(Ryan): A few r32 roundings of the result's magnitude
+    r64 tolerance_x = 4.0 * fabs(expected_dx) / (1 << 23) + 1e-6;
+    r64 tolerance_y = 4.0 * fabs(expected_dy) / (1 << 23) + 1e-6;
+    if (fabs(diff->dx - expected_dx) > tolerance_x || fabs(diff->dy - expected_dy) > tolerance_y)
+    {
+      num_failures += 1;
+    }
+  }
+  end_temporary_memory(check_memory);
+
+  *num_checks = 2 * num_positions;
+  if (num_failures > 0) BP("Position precision check failed");
+
+  return num_failures;
 }
 
-// TODO(Ryan): Ensure game is procederal and rich in combinatorics
-extern "C" void
-hhf_update_and_render(HHFThreadContext *thread_context, HHFBackBuffer *back_buffer, 
-                      HHFSoundBuffer *sound_buffer, HHFInput *input, HHFMemory *memory, 
-                      HHFPlatform *platform)
+// NOTE(Ryan): A million positions through the scalar and batch versions. Cycles per hit are 
+// per position, so read as millions of cycles per million positions
+INTERNAL void
+debug_benchmark_position_batches(MemoryArena *arena, TileMap *tile_map)
 {
-  //BP(NULL);
+  u32 num_coords = 1000000;
+  u32 random_state = 0x9E3779B9;
+  r32 tile_side = tile_map->tile_side_in_metres;
+  r32 half_tile_side = 0.5f * tile_side;
+
+  TemporaryMemory benchmark_memory = begin_temporary_memory(arena);
+  u32 *source_tiles = MEMORY_RESERVE_ARRAY(arena, num_coords, u32);
+  r32 *source_rels = MEMORY_RESERVE_ARRAY(arena, num_coords, r32);
+  u32 *scalar_tiles = MEMORY_RESERVE_ARRAY(arena, num_coords, u32);
+  r32 *scalar_rels = MEMORY_RESERVE_ARRAY(arena, num_coords, r32);
+  u32 *batch_tiles = MEMORY_RESERVE_ARRAY(arena, num_coords, u32);
+  r32 *batch_rels = MEMORY_RESERVE_ARRAY(arena, num_coords, r32);
+  for (u32 coord_i = 0; coord_i < num_coords; ++coord_i)
+  {
+    source_tiles[coord_i] = debug_random_u32(&random_state);
+    source_rels[coord_i] = 4.0f * tile_side * debug_random_bilateral(&random_state);
+  }
 
-  State *state = (State *)memory->permanent;
-  if (!memory->is_initialized)
+  memcpy(scalar_tiles, source_tiles, num_coords * sizeof(u32));
+  memcpy(scalar_rels, source_rels, num_coords * sizeof(r32));
+  BEGIN_TIMED_BLOCK(RECANONICALISE_1M);
+  for (u32 coord_i = 0; coord_i < num_coords; ++coord_i)
   {
-    // IMPORTANT(Ryan): Working with artists, only specify that certain things need to be in different layers
-    state->backdrop = load_bmp(thread_context, platform->read_entire_file, "test/test_background.bmp");
-    // TODO(Ryan): Not ideal to have large tables of strings in your code
-    PlayerBitmap *player_bitmap = state->player_bitmaps;
-    player_bitmap->head = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_right_head.bmp");
-    player_bitmap->torso = load_bmp(thread_context, platform->read_entire_file,
-                                                    "test/test_hero_right_cape.bmp");
-    player_bitmap->legs = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_right_torso.bmp");
-    player_bitmap->align_x = 72;
-    player_bitmap->align_y = 182;
-    player_bitmap++;
-
-    player_bitmap->head = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_back_head.bmp");
-    player_bitmap->torso = load_bmp(thread_context, platform->read_entire_file,
-                                                    "test/test_hero_back_cape.bmp");
-    player_bitmap->legs = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_back_torso.bmp");
-    player_bitmap->align_x = 72;
-    player_bitmap->align_y = 182;
-    player_bitmap++;
-
-    player_bitmap->head = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_left_head.bmp");
-    player_bitmap->torso = load_bmp(thread_context, platform->read_entire_file,
-                                                    "test/test_hero_left_cape.bmp");
-    player_bitmap->legs = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_left_torso.bmp");
-    player_bitmap->align_x = 72;
-    player_bitmap->align_y = 182;
-    player_bitmap++;
-
-    player_bitmap->head = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_front_head.bmp");
-    player_bitmap->torso = load_bmp(thread_context, platform->read_entire_file,
-                                                    "test/test_hero_front_cape.bmp");
-    player_bitmap->legs = load_bmp(thread_context, platform->read_entire_file, 
-                                                    "test/test_hero_front_torso.bmp");
-    player_bitmap->align_x = 72;
-    player_bitmap->align_y = 182;
+    recanonicalise_coord(tile_map, &scalar_tiles[coord_i], &scalar_rels[coord_i]);
+  }
+  END_TIMED_BLOCK_COUNTED(RECANONICALISE_1M, num_coords);
 
-    state->camera_pos.abs_tile_x = 17 / 2;
-    state->camera_pos.abs_tile_y = 9 / 2; 
+  memcpy(batch_tiles, source_tiles, num_coords * sizeof(u32));
+  memcpy(batch_rels, source_rels, num_coords * sizeof(r32));
+  BEGIN_TIMED_BLOCK(RECANONICALISE_4X_1M);
+  recanonicalise_coords_4x(tile_map, num_coords, batch_tiles, batch_rels);
+  END_TIMED_BLOCK_COUNTED(RECANONICALISE_4X_1M, num_coords);
 
-    state->player_pos.abs_tile_x = 1;
-    state->player_pos.abs_tile_y = 3;
-    state->player_pos.x_offset = 5.0f;
-    state->player_pos.y_offset = 5.0f;
+  int num_mismatches = 0;
+  for (u32 coord_i = 0; coord_i < num_coords; ++coord_i)
+  {
+    r64 scalar_pos = (r64)(s32)(scalar_tiles[coord_i] - source_tiles[coord_i]) * tile_side + 
+                     scalar_rels[coord_i];
+    r64 batch_pos = (r64)(s32)(batch_tiles[coord_i] - source_tiles[coord_i]) * tile_side + 
+                    batch_rels[coord_i];
+    if (fabsf(batch_rels[coord_i]) > half_tile_side || fabs(batch_pos - scalar_pos) > 1e-6)
+    {
+      num_mismatches += 1;
+    }
+  }
 
-    initialise_memory_arena(&state->world_arena, memory->permanent_size - sizeof(State),
-                             (u8 *)memory->permanent + sizeof(State));
+  u32 origin_tile = debug_random_u32(&random_state);
+  r32 origin_rel = half_tile_side * debug_random_bilateral(&random_state);
+  for (u32 coord_i = 0; coord_i < num_coords; ++coord_i)
+  {
+    source_tiles[coord_i] = origin_tile + (debug_random_u32(&random_state) >> 22) - 512;
+    source_rels[coord_i] = half_tile_side * debug_random_bilateral(&random_state);
+  }
 
-    state->world = MEMORY_RESERVE_STRUCT(&state->world_arena, World);
-    World *world = state->world;
-
-    world->tile_map = MEMORY_RESERVE_STRUCT(&state->world_arena, TileMap);
-    TileMap *tile_map = world->tile_map;
-
-    tile_map->chunk_shift = 4;
-    tile_map->chunk_mask = (1U << tile_map->chunk_shift) - 1;
-    tile_map->chunk_dim = (1U << tile_map->chunk_shift);
-    tile_map->num_tile_chunks_x = 128;
-    tile_map->num_tile_chunks_y = 128;
-    tile_map->num_tile_chunks_z = 2;
-    tile_map->tile_side_in_metres = 1.4f;
-    // NOTE(Ryan): For basic sparseness we allocate chunk contents when we write to them
-    int tile_map_num_chunks = tile_map->num_tile_chunks_x * tile_map->num_tile_chunks_y *
-                              tile_map->num_tile_chunks_z;
-    tile_map->chunks = MEMORY_RESERVE_ARRAY(&state->world_arena, tile_map_num_chunks, TileChunk);
-
-    srand(time(NULL));
-    int num_tiles_screen_x = 17;
-    int num_tiles_screen_y = 9;
-    int screen_x = 0;
-    int screen_y = 0;
-    int abs_tile_z = 0;
-    bool want_door = false;
-    bool have_drawn_door = false;
-    int random_index = 0;
-
-    for (int screen_i = 0; screen_i < 100; screen_i++)
-    {
-      // NOTE(Ryan): Think of mod as choice range
-      if (have_drawn_door) random_index = rand() % 2;
-      else random_index = rand() % 3;
-
-      if (random_index == 2) want_door = true;
-
-      for (int tile_y = 0; tile_y < num_tiles_screen_y; ++tile_y)
-      {
-        for (int tile_x = 0; tile_x < num_tiles_screen_x; ++tile_x)
+  BEGIN_TIMED_BLOCK(SUBTRACT_1M);
+  TileMapPosition origin = {};
+  origin.abs_tile_x = origin_tile;
+  origin.x_offset = origin_rel;
+  for (u32 coord_i = 0; coord_i < num_coords; ++coord_i)
+  {
+    TileMapPosition pos = {};
+    pos.abs_tile_x = source_tiles[coord_i];
+    pos.x_offset = source_rels[coord_i];
+    scalar_rels[coord_i] = subtract(tile_map, &pos, &origin).dx;
+  }
+  END_TIMED_BLOCK_COUNTED(SUBTRACT_1M, num_coords);
+
+  BEGIN_TIMED_BLOCK(SUBTRACT_4X_1M);
+  subtract_coords_4x(tile_map, num_coords, source_tiles, source_rels, origin_tile, origin_rel, 
+                     batch_rels);
+  END_TIMED_BLOCK_COUNTED(SUBTRACT_4X_1M, num_coords);
+
+  for (u32 coord_i = 0; coord_i < num_coords; ++coord_i)
+  {
+    if (fabsf(batch_rels[coord_i] - scalar_rels[coord_i]) > 1e-3f) num_mismatches += 1;
+  }
+  end_temporary_memory(benchmark_memory);
+
+  if (num_mismatches > 0) BP("Batch position kernels disagree with scalar");
+}
+#endif
+
+INTERNAL bool
+is_tile_value_empty(u32 tile_value)
+{
+  bool result = (tile_value == 1 || tile_value == 3 || tile_value == 4);
+
+  return result;
+}
+
+// NOTE(Ryan): Ray from rel along delta against an axis aligned wall. Only walls facing the 
+// motion are passed in, so sliding along or leaving a wall never registers a hit
+INTERNAL bool
+test_wall(r32 wall_x, r32 rel_x, r32 rel_y, r32 delta_x, r32 delta_y, 
+          r32 min_y, r32 max_y, r32 *t_min)
+{
+  bool result = false;
+
+  // NOTE(Ryan): Stop a millimetre short of the wall. Positions pick up floating point error on
+  // their way in and out of sim regions, so also catch boxes that start that close inside it
+  r32 epsilon = 0.001f;
+  r32 t_epsilon = epsilon / fabsf(delta_x);
+  r32 t_result = (wall_x - rel_x) / delta_x;
+  if (t_result >= -t_epsilon && t_result < *t_min)
+  {
+    r32 y = rel_y + t_result * delta_y;
+    if (y >= min_y && y <= max_y)
+    {
+      *t_min = (t_result - t_epsilon > 0.0f ? t_result - t_epsilon : 0.0f);
+      result = true;
+    }
+  }
+
+  return result;
+}
+
+struct SweepResult
+{
+  // NOTE(Ryan): Fraction of delta moved before impact, 1 if nothing was hit
+  r32 t;
+  V2 wall_normal;
+};
+
+// NOTE(Ryan): Box is centred on pos. Each solid tile is grown by the box's half size 
+// (Minkowski sum) so only the centre point needs sweeping. Only tiles under the swept box are
+// visited, and chunk lookups happen once per chunk rather than once per tile
+INTERNAL SweepResult
+sweep_box_against_tiles(TileMap *tile_map, TileMapPosition *pos, V2 half_dim, V2 delta)
+{
+  SweepResult result = {};
+  result.t = 1.0f;
+
+  r32 tile_side = tile_map->tile_side_in_metres;
+  r32 min_rel_x = pos->x_offset - half_dim.x + (delta.x < 0.0f ? delta.x : 0.0f);
+  r32 max_rel_x = pos->x_offset + half_dim.x + (delta.x > 0.0f ? delta.x : 0.0f);
+  r32 min_rel_y = pos->y_offset - half_dim.y + (delta.y < 0.0f ? delta.y : 0.0f);
+  r32 max_rel_y = pos->y_offset + half_dim.y + (delta.y > 0.0f ? delta.y : 0.0f);
+
+  // IMPORTANT(Ryan): Signed, so tiles just off the low edge of the world become chunk -1, 
+  // which doesn't exist and so is solid, rather than wrapping to the far side
+  s32 min_tile_x = (s32)pos->abs_tile_x + (s32)floorf(min_rel_x / tile_side + 0.5f);
+  s32 max_tile_x = (s32)pos->abs_tile_x + (s32)floorf(max_rel_x / tile_side + 0.5f);
+  s32 min_tile_y = (s32)pos->abs_tile_y + (s32)floorf(min_rel_y / tile_side + 0.5f);
+  s32 max_tile_y = (s32)pos->abs_tile_y + (s32)floorf(max_rel_y / tile_side + 0.5f);
+
+  V2 wall_min = -(0.5f * v2(tile_side, tile_side) + half_dim);
+  V2 wall_max = 0.5f * v2(tile_side, tile_side) + half_dim;
+
+  s32 chunk_shift = tile_map->chunk_shift;
+  for (s32 chunk_y = (min_tile_y >> chunk_shift); chunk_y <= (max_tile_y >> chunk_shift); ++chunk_y)
+  {
+    for (s32 chunk_x = (min_tile_x >> chunk_shift); chunk_x <= (max_tile_x >> chunk_shift); 
+         ++chunk_x)
+    {
+      TileChunk *tile_chunk = get_tile_chunk(tile_map, chunk_x, chunk_y, pos->abs_tile_z);
+      bool chunk_has_tiles = (tile_chunk != NULL && tile_chunk->tiles != NULL);
+
+      s32 first_tile_y = MAX(min_tile_y, chunk_y << chunk_shift);
+      s32 last_tile_y = MIN(max_tile_y, ((chunk_y + 1) << chunk_shift) - 1);
+      s32 first_tile_x = MAX(min_tile_x, chunk_x << chunk_shift);
+      s32 last_tile_x = MIN(max_tile_x, ((chunk_x + 1) << chunk_shift) - 1);
+      for (s32 tile_y = first_tile_y; tile_y <= last_tile_y; ++tile_y)
+      {
+        for (s32 tile_x = first_tile_x; tile_x <= last_tile_x; ++tile_x)
+        {
+          u32 tile_value = 0;
+          if (chunk_has_tiles)
+          {
+            tile_value = get_tile_value_unchecked(tile_map, tile_chunk, 
+                                                  tile_x & tile_map->chunk_mask,
+                                                  tile_y & tile_map->chunk_mask);
+          }
+          if (is_tile_value_empty(tile_value)) continue;
+
+          // NOTE(Ryan): Tile deltas are small integers, so exact before converting
+          V2 rel = v2((r32)((s32)pos->abs_tile_x - tile_x) * tile_side + pos->x_offset,
+                      (r32)((s32)pos->abs_tile_y - tile_y) * tile_side + pos->y_offset);
+          if (delta.x > 0.0f && 
+              test_wall(wall_min.x, rel.x, rel.y, delta.x, delta.y, wall_min.y, wall_max.y, 
+                        &result.t))
+          {
+            result.wall_normal = v2(-1.0f, 0.0f);
+          }
+          if (delta.x < 0.0f && 
+              test_wall(wall_max.x, rel.x, rel.y, delta.x, delta.y, wall_min.y, wall_max.y, 
+                        &result.t))
+          {
+            result.wall_normal = v2(1.0f, 0.0f);
+          }
+          if (delta.y > 0.0f && 
+              test_wall(wall_min.y, rel.y, rel.x, delta.y, delta.x, wall_min.x, wall_max.x, 
+                        &result.t))
+          {
+            result.wall_normal = v2(0.0f, -1.0f);
+          }
+          if (delta.y < 0.0f && 
+              test_wall(wall_max.y, rel.y, rel.x, delta.y, delta.x, wall_min.x, wall_max.x, 
+                        &result.t))
+          {
+            result.wall_normal = v2(0.0f, 1.0f);
+          }
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+INTERNAL bool
+is_box_clear(TileMap *tile_map, TileMapPosition *pos, V2 half_dim)
+{
+  bool result = true;
+
+  r32 tile_side = tile_map->tile_side_in_metres;
+  s32 min_tile_x = (s32)pos->abs_tile_x + (s32)floorf((pos->x_offset - half_dim.x) / tile_side + 0.5f);
+  s32 max_tile_x = (s32)pos->abs_tile_x + (s32)floorf((pos->x_offset + half_dim.x) / tile_side + 0.5f);
+  s32 min_tile_y = (s32)pos->abs_tile_y + (s32)floorf((pos->y_offset - half_dim.y) / tile_side + 0.5f);
+  s32 max_tile_y = (s32)pos->abs_tile_y + (s32)floorf((pos->y_offset + half_dim.y) / tile_side + 0.5f);
+  for (s32 tile_y = min_tile_y; tile_y <= max_tile_y && result; ++tile_y)
+  {
+    for (s32 tile_x = min_tile_x; tile_x <= max_tile_x && result; ++tile_x)
+    {
+      result = is_tile_value_empty(get_tile_value(tile_map, (u32)tile_x, (u32)tile_y, 
+                                                  pos->abs_tile_z));
+    }
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Doors only lead somewhere when there is floor to land on
+INTERNAL bool
+is_working_door(TileMap *tile_map, u32 abs_tile_x, u32 abs_tile_y, u32 abs_tile_z, u32 *to_z)
+{
+  bool result = false;
+
+  u32 tile_value = get_tile_value(tile_map, abs_tile_x, abs_tile_y, abs_tile_z);
+  if (tile_value == 3 || tile_value == 4)
+  {
+    *to_z = (tile_value == 3 ? abs_tile_z + 1 : abs_tile_z - 1);
+    result = is_tile_value_empty(get_tile_value(tile_map, abs_tile_x, abs_tile_y, *to_z));
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Moves up to the first wall, then slides the remainder along it. Offsets are left 
+// relative to pos's tile, so callers working relative to a sim region origin stay in its space.
+// Returns the first impact, a t of 1 if the whole move was free
+INTERNAL SweepResult
+move_box(TileMap *tile_map, TileMapPosition *pos, V2 half_dim, V2 delta)
+{
+  SweepResult result = {};
+  result.t = 1.0f;
+
+  TileMapPosition old_tile_pos = *pos;
+  recanonicalise_position(tile_map, &old_tile_pos);
+  for (int iteration_i = 0; iteration_i < 4; ++iteration_i)
+  {
+    SweepResult sweep = sweep_box_against_tiles(tile_map, pos, half_dim, delta);
+    pos->x_offset += sweep.t * delta.x;
+    pos->y_offset += sweep.t * delta.y;
+
+    if (sweep.t == 1.0f) break;
+    if (iteration_i == 0) result = sweep;
+
+    delta = (1.0f - sweep.t) * delta;
+    delta -= dot(delta, sweep.wall_normal) * sweep.wall_normal;
+  }
+
+  TileMapPosition new_tile_pos = *pos;
+  recanonicalise_position(tile_map, &new_tile_pos);
+  if (!are_on_same_tile(&old_tile_pos, &new_tile_pos))
+  {
+    // NOTE(Ryan): Floors differ, so also check the whole box fits where it would land
+    u32 door_to_z = 0;
+    if (is_working_door(tile_map, new_tile_pos.abs_tile_x, new_tile_pos.abs_tile_y, 
+                        new_tile_pos.abs_tile_z, &door_to_z))
+    {
+      new_tile_pos.abs_tile_z = door_to_z;
+      if (is_box_clear(tile_map, &new_tile_pos, half_dim)) pos->abs_tile_z = door_to_z;
+    }
+  }
+
+  return result;
+}
+
+INTERNAL bool
+is_entity_handle_valid(EntityStore *store, EntityHandle handle)
+{
+  bool result = (handle.slot < store->num_slots_used && 
+                 store->slot_generation[handle.slot] == handle.generation);
+
+  return result;
+}
+
+INTERNAL u32
+get_entity_index(EntityStore *store, EntityHandle handle)
+{
+  ASSERT(is_entity_handle_valid(store, handle));
+
+  u32 result = store->index_of_slot[handle.slot];
+
+  return result;
+}
+
+INTERNAL TileMapPosition
+get_entity_pos(EntityStore *store, u32 entity_i)
+{
+  TileMapPosition result = {};
+
+  result.abs_tile_x = store->abs_tile_x[entity_i];
+  result.abs_tile_y = store->abs_tile_y[entity_i];
+  result.abs_tile_z = store->abs_tile_z[entity_i];
+  result.x_offset = store->x_offset[entity_i];
+  result.y_offset = store->y_offset[entity_i];
+
+  return result;
+}
+
+INTERNAL void
+set_entity_pos(EntityStore *store, u32 entity_i, TileMapPosition *pos)
+{
+  store->abs_tile_x[entity_i] = pos->abs_tile_x;
+  store->abs_tile_y[entity_i] = pos->abs_tile_y;
+  store->abs_tile_z[entity_i] = pos->abs_tile_z;
+  store->x_offset[entity_i] = pos->x_offset;
+  store->y_offset[entity_i] = pos->y_offset;
+}
+
+INTERNAL EntityHandle
+add_entity(EntityStore *store, ENTITY_TYPE type, TileMapPosition *pos, V2 half_dim)
+{
+  EntityHandle result = {};
+  ASSERT(store->count < MAX_ENTITIES);
+
+  u32 slot = 0;
+  if (store->num_free_slots > 0)
+  {
+    slot = store->free_slots[--store->num_free_slots];
+  }
+  else
+  {
+    slot = store->num_slots_used++;
+  }
+  // NOTE(Ryan): Odd whilst live, even once removed
+  store->slot_generation[slot] += 1;
+
+  u32 entity_i = store->count++;
+  store->index_of_slot[slot] = entity_i;
+  store->slot_of_index[entity_i] = slot;
+
+  set_entity_pos(store, entity_i, pos);
+  store->velocity[entity_i] = v2(0.0f, 0.0f);
+  store->half_dim[entity_i] = half_dim;
+  store->prev_pos[entity_i] = *pos;
+  store->type[entity_i] = (u8)type;
+
+  result.slot = slot;
+  result.generation = store->slot_generation[slot];
+
+  return result;
+}
+
+// NOTE(Ryan): The last entity moves into the hole, so the arrays stay dense
+INTERNAL void
+remove_entity(EntityStore *store, EntityHandle handle)
+{
+  u32 entity_i = get_entity_index(store, handle);
+  u32 last_i = --store->count;
+
+  if (entity_i != last_i)
+  {
+    store->abs_tile_x[entity_i] = store->abs_tile_x[last_i];
+    store->abs_tile_y[entity_i] = store->abs_tile_y[last_i];
+    store->abs_tile_z[entity_i] = store->abs_tile_z[last_i];
+    store->x_offset[entity_i] = store->x_offset[last_i];
+    store->y_offset[entity_i] = store->y_offset[last_i];
+    store->velocity[entity_i] = store->velocity[last_i];
+    store->half_dim[entity_i] = store->half_dim[last_i];
+    store->prev_pos[entity_i] = store->prev_pos[last_i];
+    store->type[entity_i] = store->type[last_i];
+
+    u32 last_slot = store->slot_of_index[last_i];
+    store->slot_of_index[entity_i] = last_slot;
+    store->index_of_slot[last_slot] = entity_i;
+  }
+
+  store->slot_generation[handle.slot] += 1;
+  store->free_slots[store->num_free_slots++] = handle.slot;
+}
+
+// NOTE(Ryan): Gathers entities within half_extent of centre, on any floor as doors move them 
+// between floors. Also snapshots every entity's position for render interpolation, so those 
+// left out do not lerp from a stale position when they come back into view
+INTERNAL SimRegion *
+begin_sim(MemoryArena *arena, EntityStore *store, TileMap *tile_map, TileMapPosition *centre,
+          V2 half_extent)
+{
+  SimRegion *result = MEMORY_RESERVE_STRUCT(arena, SimRegion);
+
+  result->origin = *centre;
+  result->origin.x_offset = 0.0f;
+  result->origin.y_offset = 0.0f;
+  result->half_extent = half_extent;
+  result->count = 0;
+  result->entity_index = MEMORY_RESERVE_ARRAY(arena, store->count, u32);
+  result->abs_tile_z = MEMORY_RESERVE_ARRAY(arena, store->count, u32);
+  result->pos = MEMORY_RESERVE_ARRAY(arena, store->count, V2);
+  result->velocity = MEMORY_RESERVE_ARRAY(arena, store->count, V2);
+  result->half_dim = MEMORY_RESERVE_ARRAY(arena, store->count, V2);
+  result->type = MEMORY_RESERVE_ARRAY(arena, store->count, u8);
+
+  r32 *rel_x = MEMORY_RESERVE_ARRAY(arena, store->count, r32);
+  r32 *rel_y = MEMORY_RESERVE_ARRAY(arena, store->count, r32);
+  subtract_coords_4x(tile_map, store->count, store->abs_tile_x, store->x_offset, 
+                     result->origin.abs_tile_x, result->origin.x_offset, rel_x);
+  subtract_coords_4x(tile_map, store->count, store->abs_tile_y, store->y_offset, 
+                     result->origin.abs_tile_y, result->origin.y_offset, rel_y);
+
+  for (u32 entity_i = 0; entity_i < store->count; ++entity_i)
+  {
+    store->prev_pos[entity_i] = get_entity_pos(store, entity_i);
+
+    V2 rel = v2(rel_x[entity_i], rel_y[entity_i]);
+    if (rel.x >= -half_extent.x && rel.x < half_extent.x && 
+        rel.y >= -half_extent.y && rel.y < half_extent.y)
+    {
+      u32 sim_i = result->count++;
+      result->entity_index[sim_i] = entity_i;
+      result->abs_tile_z[sim_i] = store->abs_tile_z[entity_i];
+      result->pos[sim_i] = rel;
+      result->velocity[sim_i] = store->velocity[entity_i];
+      result->half_dim[sim_i] = store->half_dim[entity_i];
+      result->type[sim_i] = store->type[entity_i];
+    }
+  }
+
+  return result;
+}
+
+INTERNAL void
+end_sim(MemoryArena *arena, SimRegion *region, EntityStore *store, TileMap *tile_map)
+{
+  // NOTE(Ryan): Gathered per axis for the batch recanonicalise
+  u32 *tile_x = MEMORY_RESERVE_ARRAY(arena, region->count, u32);
+  u32 *tile_y = MEMORY_RESERVE_ARRAY(arena, region->count, u32);
+  r32 *rel_x = MEMORY_RESERVE_ARRAY(arena, region->count, r32);
+  r32 *rel_y = MEMORY_RESERVE_ARRAY(arena, region->count, r32);
+  for (u32 sim_i = 0; sim_i < region->count; ++sim_i)
+  {
+    tile_x[sim_i] = region->origin.abs_tile_x;
+    tile_y[sim_i] = region->origin.abs_tile_y;
+    rel_x[sim_i] = region->pos[sim_i].x;
+    rel_y[sim_i] = region->pos[sim_i].y;
+  }
+  recanonicalise_coords_4x(tile_map, region->count, tile_x, rel_x);
+  recanonicalise_coords_4x(tile_map, region->count, tile_y, rel_y);
+
+  for (u32 sim_i = 0; sim_i < region->count; ++sim_i)
+  {
+    u32 entity_i = region->entity_index[sim_i];
+
+    store->abs_tile_x[entity_i] = tile_x[sim_i];
+    store->abs_tile_y[entity_i] = tile_y[sim_i];
+    store->abs_tile_z[entity_i] = region->abs_tile_z[sim_i];
+    store->x_offset[entity_i] = rel_x[sim_i];
+    store->y_offset[entity_i] = rel_y[sim_i];
+    store->velocity[entity_i] = region->velocity[sim_i];
+  }
+}
+
+INTERNAL u32
+find_sim_entity(SimRegion *region, u32 entity_i)
+{
+  u32 result = SIM_ENTITY_NONE;
+
+  for (u32 sim_i = 0; sim_i < region->count; ++sim_i)
+  {
+    if (region->entity_index[sim_i] == entity_i)
+    {
+      result = sim_i;
+      break;
+    }
+  }
+
+  return result;
+}
+
+INTERNAL SweepResult
+move_sim_entity(SimRegion *region, TileMap *tile_map, u32 sim_i, V2 delta)
+{
+  TileMapPosition pos = region->origin;
+  pos.abs_tile_z = region->abs_tile_z[sim_i];
+  pos.x_offset = region->pos[sim_i].x;
+  pos.y_offset = region->pos[sim_i].y;
+
+  SweepResult result = move_box(tile_map, &pos, region->half_dim[sim_i], delta);
+
+  region->abs_tile_z[sim_i] = pos.abs_tile_z;
+  region->pos[sim_i] = v2(pos.x_offset, pos.y_offset);
+
+  return result;
+}
+
+struct BitmapHeader
+{
+  // TODO(Ryan): Will pack to largest size in struct?
+  u16 signature;
+  u32 file_size;
+  u32 reserved;
+  u32 data_offset;
+  u32 size;
+  u32 width;
+  u32 height;
+  u16 planes;
+  u16 bits_per_pixel;
+  u32 compression;
+  u32 size_of_bitmap;
+  u32 horz_resolution;
+  u32 vert_resolution;
+  u32 colors_used;
+  u32 colors_important;
+
+  u32 red_mask;
+  u32 green_mask;
+  u32 blue_mask;
+} __attribute__((packed));
+
+
+// NOTE(Ryan): Monitors apply roughly a 2.2 power curve to the values we write (sRGB), so 
+// blending the bytes directly mixes perceptual rather than physical light and darkens edges. 
+// Instead, decode to linear, blend, then encode back.
+// sRGB is approximated with a gamma of 2, i.e. square to decode and sqrt to encode. The scalar 
+// and SIMD blitters and the premultiply at load all use it, so a sprite comes out the same 
+// whichever blitter draws it. Exact sRGB tables cost 20-40% more in the SIMD path (gathers)
+inline r32
+srgb_to_linear(u32 srgb)
+{
+  r32 channel = srgb * (1.0f / 255.0f);
+  r32 result = channel * channel;
+
+  return result;
+}
+
+inline u32
+linear_to_srgb(r32 linear)
+{
+  // IMPORTANT(Ryan): -ffast-math lets sqrtf become x * rsqrt(x), which is NaN for 0
+  if (linear < 1.0e-10f) linear = 1.0e-10f;
+  r32 srgb = 255.0f * sqrtf(linear);
+  if (srgb > 255.0f) srgb = 255.0f;
+
+  u32 result = (u32)roundf(srgb);
+
+  return result;
+}
+
+// NOTE(Ryan): Bitmap pixels are premultiplied by alpha in linear space, so blending is 
+// src + (1 - alpha) * dst, which also makes bilinear filtering of alpha edges correct.
+// Channels go in SSE lanes, with the same operations as draw_bmp_quad so results match it
+inline u32
+blend_pixel(u32 dst, u32 src)
+{
+  // NOTE(Ryan): Widen and narrow with SSE2 unpacks and packs, as the SIMD path targets SSE2
+  __m128i zero = _mm_setzero_si128();
+  __m128 inv_255_4x = _mm_set1_ps(1.0f / 255.0f);
+  __m128i src_i_4x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((s32)src), zero), 
+                                        zero);
+  __m128i dst_i_4x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((s32)dst), zero), 
+                                        zero);
+  __m128 src_4x = _mm_mul_ps(_mm_cvtepi32_ps(src_i_4x), inv_255_4x);
+  __m128 dst_4x = _mm_mul_ps(_mm_cvtepi32_ps(dst_i_4x), inv_255_4x);
+  __m128 inv_alpha_4x = _mm_set1_ps(1.0f - (r32)(src >> 24 & 0xFF) * (1.0f / 255.0f));
+
+  __m128 linear_4x = _mm_add_ps(_mm_mul_ps(src_4x, src_4x), 
+                                _mm_mul_ps(inv_alpha_4x, _mm_mul_ps(dst_4x, dst_4x)));
+
+  // IMPORTANT(Ryan): -ffast-math lets sqrt become x * rsqrt(x), which is NaN for 0 and can 
+  // overshoot 255, so keep the input positive and clamp the output
+  linear_4x = _mm_max_ps(linear_4x, _mm_set1_ps(1.0e-10f));
+  __m128 srgb_4x = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(linear_4x), _mm_set1_ps(255.0f)), 
+                              _mm_set1_ps(255.0f));
+  __m128i srgb_i_4x = _mm_cvtps_epi32(srgb_4x);
+  // NOTE(Ryan): Lanes are at most 255, so the signed pack doesn't saturate
+  __m128i packed = _mm_packus_epi16(_mm_packs_epi32(srgb_i_4x, srgb_i_4x), zero);
+
+  u32 result = 0xff << 24 | ((u32)_mm_cvtsi128_si32(packed) & 0xFFFFFF);
+
+  return result;
+}
+
+// NOTE(Ryan): Bitmap rows from first_row (counted from the top) fill the screen rect, which 
+// is clipped to the buffer. Only spans are visited, so transparent pixels are never read or 
+// written, opaque runs are copied and only the remaining (typically edge) pixels are blended
+INTERNAL HHFRect
+blit_bmp_rows(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap, int first_row, 
+              int min_x, int min_y, int max_x, int max_y)
+{
+  int offset_x = 0;
+  if (min_x < 0) 
+  {
+    offset_x = -min_x;
+    min_x = 0;
+  }
+  int offset_y = 0;
+  if (min_y < 0) 
+  {
+    offset_y = -min_y;
+    min_y = 0;
+  }
+
+  if (max_x > back_buffer->width) max_x = back_buffer->width;
+  if (max_y > back_buffer->height) max_y = back_buffer->height;
+
+  // NOTE(Ryan): Bitmap x range visible on screen
+  int clip_min_x = offset_x;
+  int clip_max_x = offset_x + (max_x - min_x);
+
+  // NOTE(Ryan): Bitmaps are stored bottom-up
+  int bitmap_row_i = (bitmap->height - 1) - first_row - offset_y;
+  u32 *bitmap_row = (u32 *)bitmap->pixels + (bitmap->width * bitmap_row_i);
+  u32 *buffer_row = (u32 *)back_buffer->memory + (back_buffer->width * min_y + min_x);
+  for (int y = min_y; y < max_y; ++y)
+  {
+    BitmapSpan *span = bitmap->spans + bitmap->row_span_offsets[bitmap_row_i];
+    BitmapSpan *span_end = bitmap->spans + bitmap->row_span_offsets[bitmap_row_i + 1];
+    for (; span < span_end; ++span)
+    {
+      int span_min_x = span->x;
+      int span_max_x = span->x + span->len;
+      if (span_min_x < clip_min_x) span_min_x = clip_min_x;
+      if (span_max_x > clip_max_x) span_max_x = clip_max_x;
+      if (span_min_x >= span_max_x) continue;
+
+      u32 *pixel_cursor = bitmap_row + span_min_x;
+      u32 *buffer_cursor = buffer_row + (span_min_x - offset_x);
+      int span_width = span_max_x - span_min_x;
+
+      if (span->type == BITMAP_SPAN_TYPE_OPAQUE)
+      {
+        // NOTE(Ryan): Glyph strokes are a few pixels wide, where the memcpy call costs more than the copy
+        if (span_width <= 4)
+        {
+          for (int span_i = 0; span_i < span_width; ++span_i) buffer_cursor[span_i] = pixel_cursor[span_i];
+        }
+        else
+        {
+          memcpy(buffer_cursor, pixel_cursor, span_width * sizeof(u32));
+        }
+      }
+      else
+      {
+        for (int span_i = 0; span_i < span_width; ++span_i)
+        {
+          *buffer_cursor = blend_pixel(*buffer_cursor, *pixel_cursor);
+          pixel_cursor++;
+          buffer_cursor++;
+        }
+      }
+    }
+
+    buffer_row += back_buffer->width;
+    bitmap_row -= bitmap->width;
+    bitmap_row_i--;
+  }
+
+  HHFRect result = {min_x, min_y, max_x, max_y};
+
+  return result;
+}
+
+INTERNAL void
+draw_bmp(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap, r32 x, r32 y,
+         int align_x = 0, int align_y = 0)
+{
+  BEGIN_TIMED_BLOCK(DRAW_BMP);
+
+  x -= (r32)align_x;
+  y -= (r32)align_y;
+
+  int min_x = (int)roundf(x);
+  int max_x = (int)roundf(x + bitmap->width);
+  int min_y = (int)roundf(y);
+  int max_y = (int)roundf(y + bitmap->height);
+
+  HHFRect drawn = blit_bmp_rows(back_buffer, bitmap, 0, min_x, min_y, max_x, max_y);
+
+  add_dirty_rect(back_buffer, drawn.min_x, drawn.min_y, drawn.max_x, drawn.max_y);
+
+  int num_pixels = (drawn.max_x > drawn.min_x && drawn.max_y > drawn.min_y) ? 
+                   (drawn.max_x - drawn.min_x) * (drawn.max_y - drawn.min_y) : 0;
+  END_TIMED_BLOCK_COUNTED(DRAW_BMP, num_pixels);
+}
+
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): draw_bmp before span tables, reading and blending every pixel in the rect
+INTERNAL void
+debug_draw_bmp_per_pixel(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap, r32 x, r32 y,
+                         int align_x, int align_y)
+{
+  int min_x = (int)roundf(x - (r32)align_x);
+  int min_y = (int)roundf(y - (r32)align_y);
+  int max_x = min_x + bitmap->width;
+  int max_y = min_y + bitmap->height;
+
+  for (int buffer_y = MAX(min_y, 0); buffer_y < MIN(max_y, back_buffer->height); ++buffer_y)
+  {
+    u32 *buffer_row = (u32 *)back_buffer->memory + (buffer_y * back_buffer->width);
+    // NOTE(Ryan): Bitmaps are stored bottom-up
+    int bitmap_y = (bitmap->height - 1) - (buffer_y - min_y);
+    u32 *bitmap_row = bitmap->pixels + (bitmap->width * bitmap_y);
+    for (int buffer_x = MAX(min_x, 0); buffer_x < MIN(max_x, back_buffer->width); ++buffer_x)
+    {
+      buffer_row[buffer_x] = blend_pixel(buffer_row[buffer_x], bitmap_row[buffer_x - min_x]);
+    }
+  }
+}
+
+// NOTE(Ryan): Ignores the unused XX byte, which blending sets but skipped pixels keep
+INTERNAL bool
+debug_are_pixels_same_colour(u8 *a, u8 *b, u64 num_pixels)
+{
+  bool result = true;
+
+  for (u64 pixel_i = 0; pixel_i < num_pixels; ++pixel_i)
+  {
+    if ((((u32 *)a)[pixel_i] ^ ((u32 *)b)[pixel_i]) & 0x00FFFFFF)
+    {
+      result = false;
+      break;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Same layout as the sprite stress scene. Returns pixels in the sprites' rects
+INTERNAL u64
+debug_blit_sprite_stress(HHFBackBuffer *back_buffer, PlayerBitmap *player_bitmaps, 
+                         bool want_spans)
+{
+  u64 result = 0;
+
+  for (int stress_y = 0; stress_y < 4; ++stress_y)
+  {
+    for (int stress_x = 0; stress_x < 16; ++stress_x)
+    {
+      PlayerBitmap *stress_bitmap = &player_bitmaps[(stress_x + stress_y) % 4];
+      r32 stress_ground_x = 30.0f + stress_x * 60.0f;
+      r32 stress_ground_y = 180.0f + stress_y * 120.0f;
+      LoadedBitmap *stress_layers[3] = {&stress_bitmap->legs, &stress_bitmap->torso, 
+                                        &stress_bitmap->head};
+      for (int layer_i = 0; layer_i < 3; ++layer_i)
+      {
+        LoadedBitmap *layer = stress_layers[layer_i];
+        if (layer->pixels == NULL) continue;
+
+        result += layer->width * layer->height;
+        if (want_spans)
+        {
+          int min_x = (int)roundf(stress_ground_x - (r32)stress_bitmap->align_x);
+          int min_y = (int)roundf(stress_ground_y - (r32)stress_bitmap->align_y);
+          blit_bmp_rows(back_buffer, layer, 0, min_x, min_y, 
+                        min_x + layer->width, min_y + layer->height);
+        }
+        else
+        {
+          debug_draw_bmp_per_pixel(back_buffer, layer, stress_ground_x, stress_ground_y, 
+                                   stress_bitmap->align_x, stress_bitmap->align_y);
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Into two copies of the back buffer, so cycles/hit of the two compare directly
+INTERNAL void
+debug_benchmark_draw_bmp(MemoryArena *arena, HHFBackBuffer *back_buffer, 
+                         PlayerBitmap *player_bitmaps)
+{
+  TemporaryMemory temp_mem = begin_temporary_memory(arena);
+
+  u64 num_buffer_pixels = (u64)back_buffer->width * back_buffer->height;
+  u64 buffer_size = num_buffer_pixels * sizeof(u32);
+  HHFBackBuffer buffers[2] = {*back_buffer, *back_buffer};
+  for (int buffer_i = 0; buffer_i < 2; ++buffer_i)
+  {
+    buffers[buffer_i].memory = MEMORY_RESERVE_ARRAY(arena, buffer_size, u8);
+    memcpy(buffers[buffer_i].memory, back_buffer->memory, buffer_size);
+  }
+
+  BEGIN_TIMED_BLOCK(DRAW_BMP_PER_PIXEL);
+  u64 num_pixels = debug_blit_sprite_stress(&buffers[0], player_bitmaps, false);
+  END_TIMED_BLOCK_COUNTED(DRAW_BMP_PER_PIXEL, num_pixels);
+
+  BEGIN_TIMED_BLOCK(DRAW_BMP_SPANS);
+  debug_blit_sprite_stress(&buffers[1], player_bitmaps, true);
+  END_TIMED_BLOCK_COUNTED(DRAW_BMP_SPANS, num_pixels);
+
+  // NOTE(Ryan): Skipped pixels are transparent and copied ones opaque, so the output must match
+  if (!debug_are_pixels_same_colour(buffers[0].memory, buffers[1].memory, num_buffer_pixels)) 
+  {
+    BP("Span blits differ from per pixel blits");
+  }
+
+  end_temporary_memory(temp_mem);
+}
+#endif
+
+INTERNAL BITMAP_SPAN_TYPE
+get_bmp_pixel_span_type(u32 pixel, bool *is_transparent)
+{
+  u32 alpha = (pixel >> 24 & 0xFF);
+
+  *is_transparent = (alpha == 0);
+  BITMAP_SPAN_TYPE result = (alpha == 0xFF ? BITMAP_SPAN_TYPE_OPAQUE : BITMAP_SPAN_TYPE_BLEND);
+
+  return result;
+}
+
+// NOTE(Ryan): Two passes, first to count spans so the table is tightly packed in the arena 
+INTERNAL void
+build_bmp_spans(MemoryArena *arena, LoadedBitmap *bitmap)
+{
+  bitmap->row_span_offsets = MEMORY_RESERVE_ARRAY(arena, bitmap->height + 1, u32);
+
+  u32 num_spans = 0;
+  for (int pass_i = 0; pass_i < 2; ++pass_i)
+  {
+    if (pass_i == 1) bitmap->spans = MEMORY_RESERVE_ARRAY(arena, num_spans, BitmapSpan);
+    num_spans = 0;
+
+    u32 *pixels = bitmap->pixels;
+    for (int y = 0; y < bitmap->height; ++y)
+    {
+      bitmap->row_span_offsets[y] = num_spans;
+
+      int x = 0;
+      while (x < bitmap->width)
+      {
+        bool is_transparent = false;
+        BITMAP_SPAN_TYPE span_type = get_bmp_pixel_span_type(pixels[x], &is_transparent);
+
+        int span_start = x;
+        for (++x; x < bitmap->width; ++x)
+        {
+          bool next_is_transparent = false;
+          BITMAP_SPAN_TYPE next_span_type = get_bmp_pixel_span_type(pixels[x], 
+                                                                     &next_is_transparent);
+          if (next_is_transparent != is_transparent || 
+              (!is_transparent && next_span_type != span_type)) break;
+        }
+
+        if (!is_transparent)
+        {
+          if (pass_i == 1)
+          {
+            BitmapSpan *span = &bitmap->spans[num_spans];
+            span->x = span_start;
+            span->len = x - span_start;
+            span->type = span_type;
+          }
+          num_spans++;
+        }
+      }
+
+      pixels += bitmap->width;
+    }
+
+    bitmap->row_span_offsets[bitmap->height] = num_spans;
+  }
+}
+
+inline __m128
+unpack_channel_4x(__m128i texels, int shift)
+{
+  __m128 result = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, shift), 
+                                                 _mm_set1_epi32(0xFF)));
+
+  return result;
+}
+
+// NOTE(Ryan): Vector srgb_to_linear(), in [0, 1]
+inline __m128
+unpack_linear_channel_4x(__m128i texels, int shift)
+{
+  __m128 channel = _mm_mul_ps(unpack_channel_4x(texels, shift), _mm_set1_ps(1.0f / 255.0f));
+  __m128 result = _mm_mul_ps(channel, channel);
+
+  return result;
+}
+
+// NOTE(Ryan): Vector linear_to_srgb(), rounded to nearest
+inline __m128i
+pack_linear_channel_4x(__m128 linear, int shift)
+{
+  // IMPORTANT(Ryan): -ffast-math lets sqrt become x * rsqrt(x), which is NaN for 0 and can 
+  // overshoot 255, so keep the input positive and clamp the output
+  linear = _mm_max_ps(linear, _mm_set1_ps(1.0e-10f));
+  __m128 srgb = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(linear), _mm_set1_ps(255.0f)), 
+                           _mm_set1_ps(255.0f));
+  __m128i result = _mm_slli_epi32(_mm_cvtps_epi32(srgb), shift);
+
+  return result;
+}
+
+inline __m128
+lerp_4x(__m128 a, __m128 b, __m128 t)
+{
+  __m128 result = _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+
+  return result;
+}
+
+// NOTE(Ryan): origin is the top-left of the bitmap on screen, with x_axis and y_axis spanning 
+// its width and height, so scale and rotation come from the axes (which must be perpendicular).
+// Pixel centres are bilinearly sampled, so sub-pixel positions move smoothly
+INTERNAL void
+draw_bmp_quad(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap, V2 origin, V2 x_axis, V2 y_axis)
+{
+  BEGIN_TIMED_BLOCK(DRAW_BMP_QUAD);
+
+  // IMPORTANT(Ryan): Rows are filled 4 pixels at a time, so must not run past the row end
+  ASSERT((back_buffer->width & 3) == 0);
+
+  r32 x_axis_len_sq = length_sq(x_axis);
+  r32 y_axis_len_sq = length_sq(y_axis);
+  if (bitmap->pixels == NULL || x_axis_len_sq == 0.0f || y_axis_len_sq == 0.0f) return;
+
+  V2 corners[4] = {origin, origin + x_axis, origin + y_axis, origin + x_axis + y_axis};
+  r32 min_xf = corners[0].x, max_xf = corners[0].x;
+  r32 min_yf = corners[0].y, max_yf = corners[0].y;
+  for (int corner_i = 1; corner_i < 4; ++corner_i)
+  {
+    if (corners[corner_i].x < min_xf) min_xf = corners[corner_i].x;
+    if (corners[corner_i].x > max_xf) max_xf = corners[corner_i].x;
+    if (corners[corner_i].y < min_yf) min_yf = corners[corner_i].y;
+    if (corners[corner_i].y > max_yf) max_yf = corners[corner_i].y;
+  }
+
+  int min_x = floor_r32_to_int(min_xf);
+  int max_x = floor_r32_to_int(max_xf) + 1;
+  int min_y = floor_r32_to_int(min_yf);
+  int max_y = floor_r32_to_int(max_yf) + 1;
+
+  if (min_x < 0) min_x = 0;
+  if (min_y < 0) min_y = 0;
+  if (max_x > back_buffer->width) max_x = back_buffer->width;
+  if (max_y > back_buffer->height) max_y = back_buffer->height;
+
+  // NOTE(Ryan): Lanes outside the quad are masked, so widening to 4 pixel groups is harmless
+  min_x &= ~3;
+
+  V2 nx_axis = (1.0f / x_axis_len_sq) * x_axis;
+  V2 ny_axis = (1.0f / y_axis_len_sq) * y_axis;
+
+  __m128 zero_4x = _mm_set1_ps(0.0f);
+  __m128 one_4x = _mm_set1_ps(1.0f);
+  __m128 half_4x = _mm_set1_ps(0.5f);
+  __m128 inv_255_4x = _mm_set1_ps(1.0f / 255.0f);
+  __m128 texture_width_4x = _mm_set1_ps((r32)bitmap->width);
+  __m128 texture_height_4x = _mm_set1_ps((r32)bitmap->height);
+  __m128 max_texel_x_4x = _mm_set1_ps((r32)(bitmap->width - 1));
+  __m128 max_texel_y_4x = _mm_set1_ps((r32)(bitmap->height - 1));
+  __m128 nx_axis_x_4x = _mm_set1_ps(nx_axis.x);
+  __m128 nx_axis_y_4x = _mm_set1_ps(nx_axis.y);
+  __m128 ny_axis_x_4x = _mm_set1_ps(ny_axis.x);
+  __m128 ny_axis_y_4x = _mm_set1_ps(ny_axis.y);
+  __m128 pixel_centre_offsets_4x = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+  // NOTE(Ryan): Bitmaps are stored bottom-up, so texel row 0 is the last in memory
+  u32 *bitmap_top_row = bitmap->pixels + (bitmap->width * (bitmap->height - 1));
+
+  u32 *buffer_row = (u32 *)back_buffer->memory + (back_buffer->width * min_y + min_x);
+  for (int y = min_y; y < max_y; ++y)
+  {
+    __m128 dy_4x = _mm_set1_ps((r32)y + 0.5f - origin.y);
+    __m128 u_row_4x = _mm_mul_ps(dy_4x, nx_axis_y_4x);
+    __m128 v_row_4x = _mm_mul_ps(dy_4x, ny_axis_y_4x);
+
+    u32 *pixel = buffer_row;
+    for (int x = min_x; x < max_x; x += 4)
+    {
+      __m128 dx_4x = _mm_add_ps(_mm_set1_ps((r32)x - origin.x), pixel_centre_offsets_4x);
+      __m128 u_4x = _mm_add_ps(_mm_mul_ps(dx_4x, nx_axis_x_4x), u_row_4x);
+      __m128 v_4x = _mm_add_ps(_mm_mul_ps(dx_4x, ny_axis_x_4x), v_row_4x);
+
+      __m128 write_mask_4x = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u_4x, zero_4x), 
+                                                   _mm_cmplt_ps(u_4x, one_4x)),
+                                        _mm_and_ps(_mm_cmpge_ps(v_4x, zero_4x), 
+                                                   _mm_cmplt_ps(v_4x, one_4x)));
+      if (_mm_movemask_ps(write_mask_4x) == 0) 
+      {
+        pixel += 4;
+        continue;
+      }
+
+      // NOTE(Ryan): Texel centres are at half coordinates, edges clamp
+      __m128 tx_4x = _mm_sub_ps(_mm_mul_ps(u_4x, texture_width_4x), half_4x);
+      __m128 ty_4x = _mm_sub_ps(_mm_mul_ps(v_4x, texture_height_4x), half_4x);
+      tx_4x = _mm_min_ps(_mm_max_ps(tx_4x, zero_4x), max_texel_x_4x);
+      ty_4x = _mm_min_ps(_mm_max_ps(ty_4x, zero_4x), max_texel_y_4x);
+
+      // NOTE(Ryan): Truncation is floor as already clamped positive
+      __m128i texel_x_4x = _mm_cvttps_epi32(tx_4x);
+      __m128i texel_y_4x = _mm_cvttps_epi32(ty_4x);
+      __m128 fx_4x = _mm_sub_ps(tx_4x, _mm_cvtepi32_ps(texel_x_4x));
+      __m128 fy_4x = _mm_sub_ps(ty_4x, _mm_cvtepi32_ps(texel_y_4x));
+
+      alignas(16) s32 texel_x[4];
+      alignas(16) s32 texel_y[4];
+      _mm_store_si128((__m128i *)texel_x, texel_x_4x);
+      _mm_store_si128((__m128i *)texel_y, texel_y_4x);
+
+      alignas(16) u32 texel_a[4], texel_b[4], texel_c[4], texel_d[4];
+      for (int lane_i = 0; lane_i < 4; ++lane_i)
+      {
+        u32 *texel_row0 = bitmap_top_row - (texel_y[lane_i] * bitmap->width);
+        u32 *texel_row1 = texel_row0;
+        if (texel_y[lane_i] < bitmap->height - 1) texel_row1 -= bitmap->width;
+        int texel_x0 = texel_x[lane_i];
+        int texel_x1 = texel_x0;
+        if (texel_x0 < bitmap->width - 1) texel_x1 += 1;
+
+        texel_a[lane_i] = texel_row0[texel_x0];
+        texel_b[lane_i] = texel_row0[texel_x1];
+        texel_c[lane_i] = texel_row1[texel_x0];
+        texel_d[lane_i] = texel_row1[texel_x1];
+      }
+      __m128i texel_a_4x = _mm_load_si128((__m128i *)texel_a);
+      __m128i texel_b_4x = _mm_load_si128((__m128i *)texel_b);
+      __m128i texel_c_4x = _mm_load_si128((__m128i *)texel_c);
+      __m128i texel_d_4x = _mm_load_si128((__m128i *)texel_d);
+
+      // NOTE(Ryan): Filtering in linear space, texels are premultiplied so alpha edges are clean
+      __m128 texel_red_4x = lerp_4x(lerp_4x(unpack_linear_channel_4x(texel_a_4x, 16), 
+                                            unpack_linear_channel_4x(texel_b_4x, 16), fx_4x),
+                                    lerp_4x(unpack_linear_channel_4x(texel_c_4x, 16), 
+                                            unpack_linear_channel_4x(texel_d_4x, 16), fx_4x), 
+                                    fy_4x);
+      __m128 texel_green_4x = lerp_4x(lerp_4x(unpack_linear_channel_4x(texel_a_4x, 8), 
+                                              unpack_linear_channel_4x(texel_b_4x, 8), fx_4x),
+                                      lerp_4x(unpack_linear_channel_4x(texel_c_4x, 8), 
+                                              unpack_linear_channel_4x(texel_d_4x, 8), fx_4x), 
+                                      fy_4x);
+      __m128 texel_blue_4x = lerp_4x(lerp_4x(unpack_linear_channel_4x(texel_a_4x, 0), 
+                                             unpack_linear_channel_4x(texel_b_4x, 0), fx_4x),
+                                     lerp_4x(unpack_linear_channel_4x(texel_c_4x, 0), 
+                                             unpack_linear_channel_4x(texel_d_4x, 0), fx_4x), 
+                                     fy_4x);
+      __m128 texel_alpha_4x = lerp_4x(lerp_4x(unpack_channel_4x(texel_a_4x, 24), 
+                                              unpack_channel_4x(texel_b_4x, 24), fx_4x),
+                                      lerp_4x(unpack_channel_4x(texel_c_4x, 24), 
+                                              unpack_channel_4x(texel_d_4x, 24), fx_4x), fy_4x);
+
+      __m128i dest_4x = _mm_loadu_si128((__m128i *)pixel);
+      __m128 dest_red_4x = unpack_linear_channel_4x(dest_4x, 16);
+      __m128 dest_green_4x = unpack_linear_channel_4x(dest_4x, 8);
+      __m128 dest_blue_4x = unpack_linear_channel_4x(dest_4x, 0);
+
+      __m128 inv_alpha_4x = _mm_sub_ps(one_4x, _mm_mul_ps(texel_alpha_4x, inv_255_4x));
+      __m128 red_4x = _mm_add_ps(texel_red_4x, _mm_mul_ps(inv_alpha_4x, dest_red_4x));
+      __m128 green_4x = _mm_add_ps(texel_green_4x, _mm_mul_ps(inv_alpha_4x, dest_green_4x));
+      __m128 blue_4x = _mm_add_ps(texel_blue_4x, _mm_mul_ps(inv_alpha_4x, dest_blue_4x));
+      // NOTE(Ryan): Conversion rounds to nearest with the default MXCSR
+      __m128i out_4x = _mm_or_si128(
+                         _mm_or_si128(_mm_set1_epi32(0xFF << 24),
+                                      pack_linear_channel_4x(red_4x, 16)),
+                         _mm_or_si128(pack_linear_channel_4x(green_4x, 8),
+                                      pack_linear_channel_4x(blue_4x, 0)));
+
+      __m128i write_mask_i_4x = _mm_castps_si128(write_mask_4x);
+      __m128i masked_out_4x = _mm_or_si128(_mm_and_si128(write_mask_i_4x, out_4x),
+                                           _mm_andnot_si128(write_mask_i_4x, dest_4x));
+      _mm_storeu_si128((__m128i *)pixel, masked_out_4x);
+
+      pixel += 4;
+    }
+
+    buffer_row += back_buffer->width;
+  }
+
+  add_dirty_rect(back_buffer, min_x, min_y, max_x, max_y);
+
+  int num_pixels = (max_x > min_x && max_y > min_y) ? (max_x - min_x) * (max_y - min_y) : 0;
+  END_TIMED_BLOCK_COUNTED(DRAW_BMP_QUAD, num_pixels);
+}
+
+// NOTE(Ryan): Unscaled draw_bmp_quad, i.e. draw_bmp without rounding to whole pixels
+INTERNAL void
+draw_bmp_subpixel(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap, r32 x, r32 y,
+                  int align_x = 0, int align_y = 0)
+{
+  V2 origin = v2(x - (r32)align_x, y - (r32)align_y);
+  draw_bmp_quad(back_buffer, bitmap, origin, v2((r32)bitmap->width, 0.0f), 
+                v2(0.0f, (r32)bitmap->height));
+}
+
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): Exact sRGB, kept as the correct result to benchmark the approximation against
+struct SRGBTables
+{
+  bool is_initialised;
+  r32 srgb_to_linear[256];
+  // NOTE(Ryan): 12bits of linear input, as 8bits would band in the darks once encoded
+  u8 linear_to_srgb[4096];
+};
+
+// IMPORTANT(Ryan): Rebuilt whenever the data segment is clobbered by a reload
+GLOBAL SRGBTables global_srgb_tables;
+
+INTERNAL void
+initialise_srgb_tables(SRGBTables *tables)
+{
+  for (int srgb_i = 0; srgb_i < 256; ++srgb_i)
+  {
+    r32 srgb = srgb_i / 255.0f;
+    r32 linear = (srgb <= 0.04045f) ? (srgb / 12.92f) : powf((srgb + 0.055f) / 1.055f, 2.4f);
+    tables->srgb_to_linear[srgb_i] = linear;
+  }
+
+  for (int linear_i = 0; linear_i < 4096; ++linear_i)
+  {
+    r32 linear = linear_i / 4095.0f;
+    r32 srgb = (linear <= 0.0031308f) ? (linear * 12.92f) : 
+                                        (1.055f * powf(linear, 1.0f / 2.4f) - 0.055f);
+    tables->linear_to_srgb[linear_i] = (u8)roundf(srgb * 255.0f);
+  }
+
+  tables->is_initialised = true;
+}
+
+inline u32
+linear_to_srgb_exact(SRGBTables *tables, r32 linear)
+{
+  u32 linear_i = (u32)(linear * 4095.0f + 0.5f);
+  if (linear_i > 4095) linear_i = 4095;
+
+  u32 result = tables->linear_to_srgb[linear_i];
+
+  return result;
+}
+
+inline u32
+blend_pixel_exact(u32 dst, u32 src)
+{
+  SRGBTables *tables = &global_srgb_tables;
+
+  r32 inv_alpha = 1.0f - (src >> 24 & 0xFF) / 255.0f;
+
+  r32 red = tables->srgb_to_linear[src >> 16 & 0xFF] + 
+              inv_alpha * tables->srgb_to_linear[dst >> 16 & 0xFF];
+  r32 green = tables->srgb_to_linear[src >> 8 & 0xFF] + 
+                inv_alpha * tables->srgb_to_linear[dst >> 8 & 0xFF];
+  r32 blue = tables->srgb_to_linear[src >> 0 & 0xFF] + 
+               inv_alpha * tables->srgb_to_linear[dst >> 0 & 0xFF];
+
+  u32 result = 0xff << 24 | linear_to_srgb_exact(tables, red) << 16 | 
+                 linear_to_srgb_exact(tables, green) << 8 | 
+                 linear_to_srgb_exact(tables, blue) << 0; 
+
+  return result;
+}
+
+// NOTE(Ryan): Previous blend directly on sRGB values with straight alpha, kept to benchmark against
+inline u32
+blend_pixel_srgb(u32 dst, u32 src)
+{
+  r32 alpha_blend_t = (src >> 24 & 0xFF) / 255.0f;
+  
+  r32 red_orig = (dst >> 16 & 0xFF);
+  r32 new_red = (src >> 16 & 0xFF);
+  r32 red_blended = red_orig + alpha_blend_t * (new_red - red_orig);
+
+  r32 green_orig = (dst >> 8 & 0xFF);
+  r32 new_green = (src >> 8 & 0xFF);
+  r32 green_blended = green_orig + alpha_blend_t * (new_green - green_orig);
+
+  r32 blue_orig = (dst >> 0 & 0xFF);
+  r32 new_blue = (src >> 0 & 0xFF);
+  r32 blue_blended = blue_orig + alpha_blend_t * (new_blue - blue_orig);
+
+  u32 result = 0xff << 24 | (u32)roundf(red_blended) << 16 | 
+                 (u32)roundf(green_blended) << 8 | 
+                 (u32)roundf(blue_blended) << 0; 
+
+  return result;
+}
+
+// NOTE(Ryan): Same bitmap blended over the back buffer by each method, so cycles/pixel compare.
+// The last two are what draw_bmp and draw_bmp_quad run
+INTERNAL void
+debug_benchmark_blends(HHFBackBuffer *back_buffer, LoadedBitmap *bitmap)
+{
+  if (!global_srgb_tables.is_initialised) initialise_srgb_tables(&global_srgb_tables);
+
+  int width = (bitmap->width < back_buffer->width ? bitmap->width : back_buffer->width);
+  int height = (bitmap->height < back_buffer->height ? bitmap->height : back_buffer->height);
+  int num_pixels = width * height;
+
+  BEGIN_TIMED_BLOCK(BLEND_SRGB);
+  for (int y = 0; y < height; ++y)
+  {
+    u32 *dst = (u32 *)back_buffer->memory + (y * back_buffer->width);
+    u32 *src = bitmap->pixels + (y * bitmap->width);
+    for (int x = 0; x < width; ++x) dst[x] = blend_pixel_srgb(dst[x], src[x]);
+  }
+  END_TIMED_BLOCK_COUNTED(BLEND_SRGB, num_pixels);
+
+  BEGIN_TIMED_BLOCK(BLEND_LINEAR_EXACT);
+  for (int y = 0; y < height; ++y)
+  {
+    u32 *dst = (u32 *)back_buffer->memory + (y * back_buffer->width);
+    u32 *src = bitmap->pixels + (y * bitmap->width);
+    for (int x = 0; x < width; ++x) dst[x] = blend_pixel_exact(dst[x], src[x]);
+  }
+  END_TIMED_BLOCK_COUNTED(BLEND_LINEAR_EXACT, num_pixels);
+
+  BEGIN_TIMED_BLOCK(BLEND_LINEAR);
+  for (int y = 0; y < height; ++y)
+  {
+    u32 *dst = (u32 *)back_buffer->memory + (y * back_buffer->width);
+    u32 *src = bitmap->pixels + (y * bitmap->width);
+    for (int x = 0; x < width; ++x) dst[x] = blend_pixel(dst[x], src[x]);
+  }
+  END_TIMED_BLOCK_COUNTED(BLEND_LINEAR, num_pixels);
+
+  // NOTE(Ryan): Unscaled, so covers the same pixels. Its own DRAW_BMP_QUAD counter also ticks
+  BEGIN_TIMED_BLOCK(BLEND_LINEAR_SIMD);
+  draw_bmp_quad(back_buffer, bitmap, v2(0.0f, 0.0f), v2((r32)width, 0.0f), 
+                v2(0.0f, (r32)height));
+  END_TIMED_BLOCK_COUNTED(BLEND_LINEAR_SIMD, num_pixels);
+}
+#endif
+
+// TODO(Ryan): PNG RLE may not help us as our graphics are painterly?
+// NOTE(Ryan): Swizzle and premultiply in place
+INTERNAL void
+decode_bmp_pixels(BitmapHeader *bitmap_header, LoadedBitmap *bitmap)
+{
+  // IMPORTANT(Ryan): BMPs can go top-down and have compression. This just handles
+  // BMPs we create
+  u32 red_mask = bitmap_header->red_mask;
+  u32 green_mask = bitmap_header->green_mask;
+  u32 blue_mask = bitmap_header->blue_mask;
+  u32 alpha_mask = ~(red_mask | green_mask | blue_mask);
+
+  u32 red_shift = least_significant_bit_set(red_mask);
+  u32 green_shift = least_significant_bit_set(green_mask);
+  u32 blue_shift = least_significant_bit_set(blue_mask);
+  u32 alpha_shift = least_significant_bit_set(alpha_mask);
+  
+  // NOTE(Ryan): We determined bottom-up and byte order with structured art
+  u32 *pixels = bitmap->pixels;
+  for (uint y = 0; y < bitmap_header->height; ++y)
+  {
+    for (uint x = 0; x < bitmap_header->width; ++x)
+    {
+      // NOTE(Ryan): This reordering is also known as swizzling
+      u32 alpha = ((*pixels >> alpha_shift) & 0xFF);
+      u32 red = ((*pixels >> red_shift) & 0xFF);
+      u32 green = ((*pixels >> green_shift) & 0xFF);
+      u32 blue = ((*pixels >> blue_shift) & 0xFF);
+
+      // NOTE(Ryan): Premultiply in linear space, but store sRGB to keep precision in the darks
+      r32 alpha_t = alpha / 255.0f;
+      red = linear_to_srgb(alpha_t * srgb_to_linear(red));
+      green = linear_to_srgb(alpha_t * srgb_to_linear(green));
+      blue = linear_to_srgb(alpha_t * srgb_to_linear(blue));
+
+      *pixels = (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
+      pixels++;
+    }
+  }
+}
+
+struct BitmapLoad
+{
+  LoadedBitmap *bitmap;
+  char *filename;
+
+  HHFPlatformFile file;
+  BitmapHeader header;
+  HHFPlatformIORequest request;
+};
+
+// NOTE(Ryan): Every header is read at once, then every bitmap's pixels go straight into their 
+// place in the arena, so files are never held in platform memory and reads overlap
+INTERNAL void
+load_bmps(HHFThreadContext *thread, HHFPlatform *platform, MemoryArena *arena, 
+          BitmapLoad *loads, int num_loads)
+{
+  for (int load_i = 0; load_i < num_loads; ++load_i)
+  {
+    BitmapLoad *load = &loads[load_i];
+    *load->bitmap = {};
+    load->file = platform->open_file(thread, load->filename);
+    if (load->file.errno_code == 0)
+    {
+      load->request = platform->read_file_async(thread, &load->file, 0, sizeof(BitmapHeader), 
+                                                &load->header);
+    }
+  }
+
+  for (int load_i = 0; load_i < num_loads; ++load_i)
+  {
+    BitmapLoad *load = &loads[load_i];
+    if (load->file.errno_code == 0)
+    {
+      if (platform->wait_io(thread, &load->request) == HHF_IO_STATUS_COMPLETE)
+      {
+        LoadedBitmap *bitmap = load->bitmap;
+        bitmap->width = load->header.width;
+        bitmap->height = load->header.height;
+        bitmap->pixels = MEMORY_RESERVE_ARRAY(arena, bitmap->width * bitmap->height, u32);
+        load->request = platform->read_file_async(thread, &load->file, load->header.data_offset,
+                                                  bitmap->width * bitmap->height * sizeof(u32),
+                                                  bitmap->pixels);
+      }
+      else
+      {
+        load->file.errno_code = load->request.errno_code;
+      }
+    }
+  }
+
+  for (int load_i = 0; load_i < num_loads; ++load_i)
+  {
+    BitmapLoad *load = &loads[load_i];
+    if (load->file.errno_code == 0)
+    {
+      if (platform->wait_io(thread, &load->request) == HHF_IO_STATUS_COMPLETE)
+      {
+        decode_bmp_pixels(&load->header, load->bitmap);
+        build_bmp_spans(arena, load->bitmap);
+      }
+      else
+      {
+        *load->bitmap = {};
+      }
+    }
+    platform->close_file(thread, &load->file);
+  }
+}
+
+// NOTE(Ryan): Fallback for when no font sheet ships beside the game. Public domain 8x8 font 
+// (font8x8_basic), one byte per row from the top, bit 0 the leftmost pixel
+#define BUILTIN_FONT_CELL_WIDTH 8
+#define BUILTIN_FONT_CELL_HEIGHT 10
+GLOBAL u8 global_builtin_font_rows[FONT_NUM_CHARS][8] = 
+{
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+  {0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00}, // '!'
+  {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // '"'
+  {0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00}, // '#'
+  {0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00}, // '$'
+  {0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00}, // '%'
+  {0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00}, // '&'
+  {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00}, // '''
+  {0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00}, // '('
+  {0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00}, // ')'
+  {0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00}, // '*'
+  {0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00}, // '+'
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ','
+  {0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00}, // '-'
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // '.'
+  {0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00}, // '/'
+  {0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00}, // '0'
+  {0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00}, // '1'
+  {0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00}, // '2'
+  {0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00}, // '3'
+  {0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00}, // '4'
+  {0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00}, // '5'
+  {0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00}, // '6'
+  {0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00}, // '7'
+  {0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00}, // '8'
+  {0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00}, // '9'
+  {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // ':'
+  {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ';'
+  {0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00}, // '<'
+  {0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00}, // '='
+  {0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00}, // '>'
+  {0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00}, // '?'
+  {0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, // '@'
+  {0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00}, // 'A'
+  {0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00}, // 'B'
+  {0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00}, // 'C'
+  {0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00}, // 'D'
+  {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00}, // 'E'
+  {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00}, // 'F'
+  {0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00}, // 'G'
+  {0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00}, // 'H'
+  {0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'I'
+  {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00}, // 'J'
+  {0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00}, // 'K'
+  {0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00}, // 'L'
+  {0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00}, // 'M'
+  {0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00}, // 'N'
+  {0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00}, // 'O'
+  {0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00}, // 'P'
+  {0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00}, // 'Q'
+  {0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00}, // 'R'
+  {0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00}, // 'S'
+  {0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'T'
+  {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00}, // 'U'
+  {0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // 'V'
+  {0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00}, // 'W'
+  {0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00}, // 'X'
+  {0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00}, // 'Y'
+  {0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00}, // 'Z'
+  {0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00}, // '['
+  {0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00}, // '\'
+  {0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00}, // ']'
+  {0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00}, // '^'
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF}, // '_'
+  {0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}, // '`'
+  {0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00}, // 'a'
+  {0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00}, // 'b'
+  {0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00}, // 'c'
+  {0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00}, // 'd'
+  {0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00}, // 'e'
+  {0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00}, // 'f'
+  {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // 'g'
+  {0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00}, // 'h'
+  {0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'i'
+  {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E}, // 'j'
+  {0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00}, // 'k'
+  {0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'l'
+  {0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00}, // 'm'
+  {0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00}, // 'n'
+  {0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00}, // 'o'
+  {0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F}, // 'p'
+  {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78}, // 'q'
+  {0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00}, // 'r'
+  {0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00}, // 's'
+  {0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00}, // 't'
+  {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00}, // 'u'
+  {0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // 'v'
+  {0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00}, // 'w'
+  {0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00}, // 'x'
+  {0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // 'y'
+  {0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00}, // 'z'
+  {0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00}, // '{'
+  {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}, // '|'
+  {0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00}, // '}'
+  {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // '~'
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // DEL
+};
+
+// NOTE(Ryan): Laid out as a loaded sheet would be, bottom-up with opaque white ink, so it goes 
+// through build_font_atlas() unchanged. Glyphs sit a row down in their cells to space lines
+INTERNAL void
+build_builtin_font_sheet(MemoryArena *arena, LoadedBitmap *sheet)
+{
+  sheet->width = FONT_SHEET_COLUMNS * BUILTIN_FONT_CELL_WIDTH;
+  sheet->height = FONT_SHEET_ROWS * BUILTIN_FONT_CELL_HEIGHT;
+  sheet->pixels = MEMORY_RESERVE_ARRAY(arena, sheet->width * sheet->height, u32);
+  memset(sheet->pixels, 0, sheet->width * sheet->height * sizeof(u32));
+
+  for (int glyph_i = 0; glyph_i < FONT_NUM_CHARS; ++glyph_i)
+  {
+    int cell_x = (glyph_i % FONT_SHEET_COLUMNS) * BUILTIN_FONT_CELL_WIDTH;
+    int cell_y = (glyph_i / FONT_SHEET_COLUMNS) * BUILTIN_FONT_CELL_HEIGHT;
+    for (int y = 0; y < 8; ++y)
+    {
+      u32 *sheet_row = sheet->pixels + (sheet->height - 1 - (cell_y + 1 + y)) * sheet->width;
+      u8 glyph_row = global_builtin_font_rows[glyph_i][y];
+      for (int x = 0; x < 8; ++x)
+      {
+        if (glyph_row & (1 << x)) sheet_row[cell_x + x] = 0xFFFFFFFF;
+      }
+    }
+  }
+}
+
+// NOTE(Ryan): Sheet pixels are already decoded, so glyph rows are copied straight across
+INTERNAL void
+build_font_atlas(MemoryArena *arena, LoadedBitmap *sheet, LoadedFont *font)
+{
+  *font = {};
+  if (sheet->pixels == NULL) return;
+
+  int cell_width = sheet->width / FONT_SHEET_COLUMNS;
+  int cell_height = sheet->height / FONT_SHEET_ROWS;
+  font->advance = cell_width;
+  font->line_height = cell_height;
+
+  int atlas_width = 0;
+  int atlas_height = 0;
+  for (int glyph_i = 0; glyph_i < FONT_NUM_CHARS; ++glyph_i)
+  {
+    FontGlyph *glyph = &font->glyphs[glyph_i];
+    int cell_x = (glyph_i % FONT_SHEET_COLUMNS) * cell_width;
+    int cell_y = (glyph_i / FONT_SHEET_COLUMNS) * cell_height;
+
+    int min_x = cell_width, min_y = cell_height, max_x = 0, max_y = 0;
+    for (int y = 0; y < cell_height; ++y)
+    {
+      u32 *sheet_row = sheet->pixels + (sheet->height - 1 - (cell_y + y)) * sheet->width;
+      for (int x = 0; x < cell_width; ++x)
+      {
+        if ((sheet_row[cell_x + x] >> 24) != 0)
+        {
+          min_x = MIN(min_x, x);
+          min_y = MIN(min_y, y);
+          max_x = MAX(max_x, x + 1);
+          max_y = MAX(max_y, y + 1);
+        }
+      }
+    }
+
+    if (max_x > min_x)
+    {
+      glyph->offset_x = min_x;
+      glyph->offset_y = min_y;
+      glyph->width = max_x - min_x;
+      glyph->height = max_y - min_y;
+    }
+    glyph->atlas_row = atlas_height;
+    atlas_width = MAX(atlas_width, glyph->width);
+    atlas_height += glyph->height;
+  }
+
+  LoadedBitmap *atlas = &font->atlas;
+  atlas->width = atlas_width;
+  atlas->height = atlas_height;
+  atlas->pixels = MEMORY_RESERVE_ARRAY(arena, atlas_width * atlas_height, u32);
+  memset(atlas->pixels, 0, atlas_width * atlas_height * sizeof(u32));
+  for (int glyph_i = 0; glyph_i < FONT_NUM_CHARS; ++glyph_i)
+  {
+    FontGlyph *glyph = &font->glyphs[glyph_i];
+    int cell_x = (glyph_i % FONT_SHEET_COLUMNS) * cell_width;
+    int cell_y = (glyph_i / FONT_SHEET_COLUMNS) * cell_height;
+    for (int y = 0; y < glyph->height; ++y)
+    {
+      u32 *sheet_row = sheet->pixels + 
+                       (sheet->height - 1 - (cell_y + glyph->offset_y + y)) * sheet->width;
+      u32 *atlas_row = atlas->pixels + (atlas_height - 1 - (glyph->atlas_row + y)) * atlas_width;
+      memcpy(atlas_row, sheet_row + cell_x + glyph->offset_x, glyph->width * sizeof(u32));
+    }
+  }
+  build_bmp_spans(arena, atlas);
+}
+
+// NOTE(Ryan): Top-left of the first line at x, y. Newlines start the next line
+INTERNAL void
+push_text(TextBatch *batch, LoadedFont *font, int x, int y, char *text)
+{
+  if (font->atlas.pixels == NULL) return;
+
+  int pen_x = x;
+  int pen_y = y;
+  for (char *at = text; *at != '\0'; ++at)
+  {
+    if (*at == '\n')
+    {
+      pen_x = x;
+      pen_y += font->line_height;
+      continue;
+    }
+
+    int glyph_i = *at - FONT_FIRST_CHAR;
+    if (glyph_i < 0 || glyph_i >= FONT_NUM_CHARS) glyph_i = '?' - FONT_FIRST_CHAR;
+
+    FontGlyph *glyph = &font->glyphs[glyph_i];
+    if (glyph->width > 0 && batch->num_glyphs < TEXT_BATCH_MAX_GLYPHS)
+    {
+      TextBatchGlyph *batch_glyph = &batch->glyphs[batch->num_glyphs++];
+      batch_glyph->x = (s16)(pen_x + glyph->offset_x);
+      batch_glyph->y = (s16)(pen_y + glyph->offset_y);
+      batch_glyph->glyph_i = (u8)glyph_i;
+
+      if (batch->num_glyphs == 1)
+      {
+        batch->min_x = batch_glyph->x;
+        batch->min_y = batch_glyph->y;
+        batch->max_x = batch_glyph->x + glyph->width;
+        batch->max_y = batch_glyph->y + glyph->height;
+      }
+      batch->min_x = MIN(batch->min_x, batch_glyph->x);
+      batch->min_y = MIN(batch->min_y, batch_glyph->y);
+      batch->max_x = MAX(batch->max_x, batch_glyph->x + glyph->width);
+      batch->max_y = MAX(batch->max_y, batch_glyph->y + glyph->height);
+    }
+
+    pen_x += font->advance;
+  }
+}
+
+INTERNAL void
+flush_text_batch(HHFBackBuffer *back_buffer, TextBatch *batch, LoadedFont *font)
+{
+  BEGIN_TIMED_BLOCK(DRAW_TEXT);
+
+  for (u32 batch_glyph_i = 0; batch_glyph_i < batch->num_glyphs; ++batch_glyph_i)
+  {
+    TextBatchGlyph *batch_glyph = &batch->glyphs[batch_glyph_i];
+    FontGlyph *glyph = &font->glyphs[batch_glyph->glyph_i];
+    blit_bmp_rows(back_buffer, &font->atlas, glyph->atlas_row, batch_glyph->x, batch_glyph->y, 
+                  batch_glyph->x + glyph->width, batch_glyph->y + glyph->height);
+  }
+
+  if (batch->num_glyphs > 0)
+  {
+    add_dirty_rect(back_buffer, batch->min_x, batch->min_y, batch->max_x, batch->max_y);
+  }
+
+  END_TIMED_BLOCK_COUNTED(DRAW_TEXT, batch->num_glyphs);
+  batch->num_glyphs = 0;
+}
+
+#if defined(HHF_INTERNAL)
+INTERNAL char *
+get_debug_cycle_counter_name(int counter_i)
+{
+  char *result = "?";
+
+  switch (counter_i)
+  {
+    case DEBUG_CYCLE_COUNTER_UPDATE_AND_RENDER: result = "update_and_render"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_RECT: result = "draw_rect"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_RECT_PER_PIXEL: result = "draw_rect_per_pixel"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_BMP: result = "draw_bmp"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_BMP_PER_PIXEL: result = "draw_bmp_per_pixel"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_BMP_SPANS: result = "draw_bmp_spans"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_BMP_QUAD: result = "draw_bmp_quad"; break;
+    case DEBUG_CYCLE_COUNTER_RENDER_TILE_LAYER: result = "render_tile_layer"; break;
+    case DEBUG_CYCLE_COUNTER_RENDER_TILE_LAYER_PER_TILE: result = "render_tile_layer_per_tile"; break;
+    case DEBUG_CYCLE_COUNTER_BLIT_TILE_LAYER: result = "blit_tile_layer"; break;
+    case DEBUG_CYCLE_COUNTER_BLEND_SRGB: result = "blend_srgb"; break;
+    case DEBUG_CYCLE_COUNTER_BLEND_LINEAR_EXACT: result = "blend_linear_exact"; break;
+    case DEBUG_CYCLE_COUNTER_BLEND_LINEAR: result = "blend_linear"; break;
+    case DEBUG_CYCLE_COUNTER_BLEND_LINEAR_SIMD: result = "blend_linear_simd"; break;
+    case DEBUG_CYCLE_COUNTER_SIMULATE_ENTITIES: result = "simulate_entities"; break;
+    case DEBUG_CYCLE_COUNTER_SPATIAL_HASH_1K: result = "spatial_hash_1k"; break;
+    case DEBUG_CYCLE_COUNTER_SPATIAL_HASH_10K: result = "spatial_hash_10k"; break;
+    case DEBUG_CYCLE_COUNTER_SPATIAL_HASH_100K: result = "spatial_hash_100k"; break;
+    case DEBUG_CYCLE_COUNTER_BUILD_FLOW_FIELD: result = "build_flow_field"; break;
+    case DEBUG_CYCLE_COUNTER_RECANONICALISE: result = "recanonicalise"; break;
+    case DEBUG_CYCLE_COUNTER_SUBTRACT: result = "subtract"; break;
+    case DEBUG_CYCLE_COUNTER_RECANONICALISE_1M: result = "recanonicalise_1m"; break;
+    case DEBUG_CYCLE_COUNTER_RECANONICALISE_4X_1M: result = "recanonicalise_4x_1m"; break;
+    case DEBUG_CYCLE_COUNTER_SUBTRACT_1M: result = "subtract_1m"; break;
+    case DEBUG_CYCLE_COUNTER_SUBTRACT_4X_1M: result = "subtract_4x_1m"; break;
+    case DEBUG_CYCLE_COUNTER_TILE_LAYOUT_ROW_MAJOR_COLUMNS: result = "tile_layout_row_major_columns"; break;
+    case DEBUG_CYCLE_COUNTER_TILE_LAYOUT_MORTON_COLUMNS: result = "tile_layout_morton_columns"; break;
+    case DEBUG_CYCLE_COUNTER_TILE_LAYOUT_ROW_MAJOR_RANDOM: result = "tile_layout_row_major_random"; break;
+    case DEBUG_CYCLE_COUNTER_TILE_LAYOUT_MORTON_RANDOM: result = "tile_layout_morton_random"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_TEXT: result = "draw_text"; break;
+    case DEBUG_CYCLE_COUNTER_DRAW_TEXT_PER_PIXEL: result = "draw_text_per_pixel"; break;
+  }
+
+  return result;
+}
+
+INTERNAL void
+push_debug_arena_usage(TextBatch *batch, LoadedFont *font, int x, int y, char *name, 
+                       MemoryArena *arena)
+{
+  char line[128] = {};
+  snprintf(line, sizeof(line), "%-16s %10zuKB, peak %10zuKB / %10zuKB (%5.1f%%)", name, 
+           arena->used / 1024, arena->peak_used / 1024, arena->size / 1024, 
+           arena->size > 0 ? 100.0f * (r32)arena->peak_used / (r32)arena->size : 0.0f);
+  push_text(batch, font, x, y, line);
+}
+
+// NOTE(Ryan): Everything shown is kept by the platform in HHFMemory, so it carries across 
+// hot reloads. Cycle counts are from the previous frame, as the current one is still running
+INTERNAL void
+draw_debug_overlay(HHFBackBuffer *back_buffer, TextBatch *batch, LoadedFont *font, 
+                   HHFMemory *memory, State *state, TransientState *tran_state,
+                   int samples_per_second)
+{
+  int line_height = font->line_height > 0 ? font->line_height : 12;
+  int advance = font->advance > 0 ? font->advance : 8;
+  int pad = 8;
+  int graph_height = 4 * line_height;
+  int audio_bar_height = line_height;
+
+  int num_active_counters = 0;
+  int num_benchmark_counters = 0;
+  for (int counter_i = 0; counter_i < DEBUG_CYCLE_COUNTER_COUNT; ++counter_i)
+  {
+    if (memory->debug_prev_cycle_counters[counter_i].hit_count > 0) num_active_counters++;
+    if (tran_state->debug_benchmark_counters[counter_i].hit_count > 0) num_benchmark_counters++;
+  }
+
+  // NOTE(Ryan): Sized up front, so the background is drawn first. Once the dirty rects run 
+  // out, the bars within it just grow the last rect over the panel
+  int panel_min_x = pad;
+  int panel_min_y = pad;
+  int panel_width = 80 * advance + 2 * pad;
+  int panel_height = pad + line_height + graph_height + line_height + 
+                     (1 + num_active_counters) * line_height + line_height + 
+                     (2 + num_benchmark_counters) * line_height + line_height + 
+                     3 * line_height + line_height + 
+                     2 * line_height + audio_bar_height + pad;
+  draw_rect(back_buffer, panel_min_x, panel_min_y, panel_min_x + panel_width, 
+            panel_min_y + panel_height, 0.1f, 0.1f, 0.15f);
+
+  int x = panel_min_x + pad;
+  int y = panel_min_y + pad;
+  char line[128] = {};
+
+  // NOTE(Ryan): Frame times, oldest on the left, scaled so the target sits halfway up
+  r32 target_ms = memory->debug_target_ms_per_frame > 0.0f ? 
+                  memory->debug_target_ms_per_frame : 1000.0f / 60.0f;
+  r32 worst_ms = 0.0f;
+  for (u32 marker_i = 0; marker_i < HHF_DEBUG_NUM_FRAME_MARKERS; ++marker_i)
+  {
+    worst_ms = MAX(worst_ms, memory->debug_frame_markers[marker_i].ms_per_frame);
+  }
+  snprintf(line, sizeof(line), "frame %.02fms, work %.02fms, target %.02fms, worst %.02fms/%d, "
+           "missed %u", memory->debug_ms_per_frame, memory->debug_work_estimate_ms, target_ms, 
+           worst_ms, HHF_DEBUG_NUM_FRAME_MARKERS, memory->debug_num_missed_frames);
+  push_text(batch, font, x, y, line);
+  y += line_height;
+
+  int bar_width = (panel_width - 2 * pad) / HHF_DEBUG_NUM_FRAME_MARKERS;
+  if (bar_width < 1) bar_width = 1;
+  r32 pixels_per_ms = (0.5f * graph_height) / target_ms;
+  int graph_max_y = y + graph_height;
+  for (u32 bar_i = 0; bar_i < HHF_DEBUG_NUM_FRAME_MARKERS; ++bar_i)
+  {
+    u32 marker_i = (memory->debug_frame_marker_i + bar_i) % HHF_DEBUG_NUM_FRAME_MARKERS;
+    r32 ms_per_frame = memory->debug_frame_markers[marker_i].ms_per_frame;
+    r32 bar_height = MIN(ms_per_frame * pixels_per_ms, (r32)graph_height);
+    bool is_over_target = ms_per_frame > target_ms * 1.05f;
+    int bar_min_x = x + bar_i * bar_width;
+    draw_rect(back_buffer, bar_min_x, graph_max_y - bar_height, bar_min_x + bar_width - 1, 
+              graph_max_y, is_over_target ? 0.9f : 0.2f, is_over_target ? 0.2f : 0.8f, 0.2f);
+  }
+  int target_y = graph_max_y - (int)(0.5f * graph_height);
+  draw_rect(back_buffer, x, target_y, x + HHF_DEBUG_NUM_FRAME_MARKERS * bar_width, 
+            target_y + 1, 1.0f, 1.0f, 1.0f);
+  y = graph_max_y + line_height;
+
+  // NOTE(Ryan): Every block is timed within update_and_render, so shares are of that. 
+  // Blocks can also nest in each other, e.g. draw_rect within render_tile_layer
+  u64 frame_cycles = memory->debug_prev_cycle_counters[DEBUG_CYCLE_COUNTER_UPDATE_AND_RENDER].cycle_count;
+  snprintf(line, sizeof(line), "%-32s %10s %9s %10s %6s", "block", "Mcycles", "hits", 
+           "cy/hit", "%");
+  push_text(batch, font, x, y, line);
+  y += line_height;
+  for (int counter_i = 0; counter_i < DEBUG_CYCLE_COUNTER_COUNT; ++counter_i)
+  {
+    HHFDebugCycleCounter *counter = &memory->debug_prev_cycle_counters[counter_i];
+    if (counter->hit_count == 0) continue;
+
+    int depth = (counter_i == DEBUG_CYCLE_COUNTER_UPDATE_AND_RENDER) ? 0 : 2;
+    snprintf(line, sizeof(line), "%*s%-*s %10.3f %9" PRIu64 " %10" PRIu64 " %6.1f", 
+             depth, "", 32 - depth, get_debug_cycle_counter_name(counter_i), 
+             counter->cycle_count / 1000000.0, counter->hit_count, 
+             counter->cycle_count / counter->hit_count,
+             frame_cycles > 0 ? 100.0 * counter->cycle_count / frame_cycles : 0.0);
+    push_text(batch, font, x, y, line);
+    y += line_height;
+  }
+  y += line_height;
+
+  snprintf(line, sizeof(line), "%-32s %10s %9s %10s", "benchmark (F3)", "Mcycles", "hits", 
+           "cy/hit");
+  push_text(batch, font, x, y, line);
+  y += line_height;
+  for (int counter_i = 0; counter_i < DEBUG_CYCLE_COUNTER_COUNT; ++counter_i)
+  {
+    HHFDebugCycleCounter *counter = &tran_state->debug_benchmark_counters[counter_i];
+    if (counter->hit_count == 0) continue;
+
+    snprintf(line, sizeof(line), "  %-30s %10.3f %9" PRIu64 " %10" PRIu64, 
+             get_debug_cycle_counter_name(counter_i), counter->cycle_count / 1000000.0, 
+             counter->hit_count, counter->cycle_count / counter->hit_count);
+    push_text(batch, font, x, y, line);
+    y += line_height;
+  }
+  snprintf(line, sizeof(line), "  position precision failures %u/%u", 
+           tran_state->debug_num_precision_failures, tran_state->debug_num_precision_checks);
+  push_text(batch, font, x, y, line);
+  y += line_height;
+  y += line_height;
+
+  push_debug_arena_usage(batch, font, x, y, "asset arena", &state->asset_arena);
+  y += line_height;
+  push_debug_arena_usage(batch, font, x, y, "world arena", &state->world_arena);
+  y += line_height;
+  push_debug_arena_usage(batch, font, x, y, "transient arena", &tran_state->arena);
+  y += 2 * line_height;
+
+  // NOTE(Ryan): Cursors of every recorded frame over the last half second of written audio. 
+  // The gap between a frame's play (white) and write (red) cursor is its output latency
+  HHFDebugFrameMarker *newest_marker = &memory->debug_frame_markers[
+    (memory->debug_frame_marker_i + HHF_DEBUG_NUM_FRAME_MARKERS - 1) % HHF_DEBUG_NUM_FRAME_MARKERS];
+  r32 latency_ms = 0.0f;
+  if (newest_marker->audio_play_cursor > 0 && samples_per_second > 0)
+  {
+    latency_ms = 1000.0f * (newest_marker->audio_write_cursor - newest_marker->audio_play_cursor) / 
+                 samples_per_second;
+  }
+  snprintf(line, sizeof(line), "audio play %" PRIu64 ", write %" PRIu64 ", latency %.01fms", 
+           newest_marker->audio_play_cursor, newest_marker->audio_write_cursor, latency_ms);
+  push_text(batch, font, x, y, line);
+  y += line_height;
+
+  int audio_bar_width = panel_width - 2 * pad;
+  u64 window_samples = samples_per_second / 2;
+  draw_rect(back_buffer, x, y, x + audio_bar_width, y + audio_bar_height, 0.25f, 0.25f, 0.3f);
+  if (window_samples > 0 && newest_marker->audio_write_cursor > window_samples)
+  {
+    u64 window_start = newest_marker->audio_write_cursor - window_samples;
+    r32 pixels_per_sample = (r32)audio_bar_width / window_samples;
+    for (u32 marker_i = 0; marker_i < HHF_DEBUG_NUM_FRAME_MARKERS; ++marker_i)
+    {
+      HHFDebugFrameMarker *marker = &memory->debug_frame_markers[marker_i];
+      bool is_newest = (marker == newest_marker);
+      int tick_min_y = is_newest ? y : y + audio_bar_height / 2;
+      if (marker->audio_play_cursor > window_start)
+      {
+        int play_x = x + (int)((marker->audio_play_cursor - window_start) * pixels_per_sample);
+        draw_rect(back_buffer, play_x, tick_min_y, play_x + 1, y + audio_bar_height, 
+                  1.0f, 1.0f, 1.0f);
+      }
+      if (marker->audio_write_cursor > window_start)
+      {
+        int write_x = x + (int)((marker->audio_write_cursor - window_start) * pixels_per_sample);
+        write_x = MIN(write_x, x + audio_bar_width - 1);
+        draw_rect(back_buffer, write_x, tick_min_y, write_x + 1, y + audio_bar_height, 
+                  1.0f, 0.2f, 0.2f);
+      }
+    }
+  }
+}
+#endif
+
+INTERNAL TileDrawList *
+get_tile_draw_list(MemoryArena *arena, TileDrawList *draw_lists, TileMap *tile_map, 
+                   TileChunk *tile_chunk)
+{
+  TileDrawList *result = &draw_lists[tile_chunk - tile_map->chunks];
+
+  if (result->built_generation != tile_chunk->generation + 1)
+  {
+    if (result->runs == NULL)
+    {
+      result->runs = MEMORY_RESERVE_ARRAY(arena, tile_map->chunk_dim * tile_map->chunk_dim, u32);
+    }
+
+    result->num_runs = 0;
+    for (u32 tile_y = 0; tile_y < tile_map->chunk_dim; ++tile_y)
+    {
+      u32 run_value = 0;
+      for (u32 tile_x = 0; tile_x < tile_map->chunk_dim; ++tile_x)
+      {
+        u32 tile_value = get_tile_value_unchecked(tile_map, tile_chunk, tile_x, tile_y);
+        ASSERT(tile_value <= 0xFF);
+        // TODO(Ryan): 0 is not defined, 1 is walkable, 2 is wall
+        if (tile_value <= 1) 
+        {
+          run_value = 0;
+        }
+        else if (tile_value == run_value)
+        {
+          result->runs[result->num_runs - 1] += (1 << 16);
+        }
+        else
+        {
+          result->runs[result->num_runs++] = tile_x | (tile_y << 8) | (tile_value << 24);
+          run_value = tile_value;
+        }
+      }
+    }
+    result->built_generation = tile_chunk->generation + 1;
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Only chunks overlapping the buffer are visited, so the tiles drawn follow the 
+// buffer size and tile scale rather than a fixed area around the camera
+INTERNAL void
+render_tile_layer(HHFBackBuffer *buffer, MemoryArena *arena, TileDrawList *draw_lists,
+                  TileMap *tile_map, LoadedBitmap *backdrop, TileMapPosition *camera_pos, 
+                  r32 tile_side_in_pixels)
+{
+  BEGIN_TIMED_BLOCK(RENDER_TILE_LAYER);
+
+  // NOTE(Ryan): Nothing uploads the layer, so its dirty rects are just reset
+  buffer->num_dirty_rects = 0;
+
+  r32 screen_centre_x = (r32)buffer->width * 0.5f;
+  r32 screen_centre_y = (r32)buffer->height * 0.5f;
+  r32 metres_to_pixels = (r32)tile_side_in_pixels / (r32)tile_map->tile_side_in_metres;
+
+  draw_bmp(buffer, backdrop, 0.0f, 0.0f); 
+
+  // IMPORTANT(Ryan): Smooth scrolling acheived by drawing the map around the player,
+  // whilst keeping the player in the centre of the screen.
+  // Therefore, incorporate the player offset in the tile drawing
+  r32 origin_x = screen_centre_x - (metres_to_pixels*camera_pos->x_offset);
+  r32 origin_y = screen_centre_y + (metres_to_pixels*camera_pos->y_offset);
+
+  // NOTE(Ryan): Tiles relative to the camera's tile whose square reaches into the buffer. 
+  // Screen y is down, tile y is up
+  s32 min_rel_x = (s32)floorf(-origin_x / tile_side_in_pixels - 0.5f);
+  s32 max_rel_x = (s32)ceilf(((r32)buffer->width - origin_x) / tile_side_in_pixels + 0.5f);
+  s32 min_rel_y = (s32)floorf((origin_y - (r32)buffer->height) / tile_side_in_pixels - 0.5f);
+  s32 max_rel_y = (s32)ceilf(origin_y / tile_side_in_pixels + 0.5f);
+
+  // IMPORTANT(Ryan): Signed, so tiles just off the low edge of the world become chunk -1, 
+  // which doesn't exist, rather than wrapping to the far side
+  s32 camera_tile_x = (s32)camera_pos->abs_tile_x;
+  s32 camera_tile_y = (s32)camera_pos->abs_tile_y;
+  s32 chunk_shift = tile_map->chunk_shift;
+  s32 min_chunk_x = (camera_tile_x + min_rel_x) >> chunk_shift;
+  s32 max_chunk_x = (camera_tile_x + max_rel_x) >> chunk_shift;
+  s32 min_chunk_y = (camera_tile_y + min_rel_y) >> chunk_shift;
+  s32 max_chunk_y = (camera_tile_y + max_rel_y) >> chunk_shift;
+
+  for (s32 chunk_y = min_chunk_y; chunk_y <= max_chunk_y; ++chunk_y)
+  {
+    for (s32 chunk_x = min_chunk_x; chunk_x <= max_chunk_x; ++chunk_x)
+    {
+      TileChunk *tile_chunk = get_tile_chunk(tile_map, chunk_x, chunk_y, camera_pos->abs_tile_z);
+      if (tile_chunk == NULL || tile_chunk->tiles == NULL) continue;
+
+      TileDrawList *draw_list = get_tile_draw_list(arena, draw_lists, tile_map, tile_chunk);
+      s32 chunk_rel_x = (chunk_x << chunk_shift) - camera_tile_x;
+      s32 chunk_rel_y = (chunk_y << chunk_shift) - camera_tile_y;
+      for (u32 run_i = 0; run_i < draw_list->num_runs; ++run_i)
+      {
+        u32 run = draw_list->runs[run_i];
+        s32 first_rel_x = chunk_rel_x + (s32)(run & 0xFF);
+        s32 last_rel_x = first_rel_x + (s32)((run >> 16) & 0xFF);
+        s32 rel_y = chunk_rel_y + (s32)((run >> 8) & 0xFF);
+        if (last_rel_x < min_rel_x || first_rel_x > max_rel_x || 
+            rel_y < min_rel_y || rel_y > max_rel_y)
+        {
+          continue;
+        }
+
+        u32 tile_id = run >> 24;
+        r32 whitescale = 0.5f;
+        if (tile_id == 2) whitescale = 1.0f;
+        if (tile_id == 3 || tile_id == 4) whitescale = 0.25f;
+
+        r32 first_centre_x = origin_x + ((r32)first_rel_x * tile_side_in_pixels);
+        r32 last_centre_x = origin_x + ((r32)last_rel_x * tile_side_in_pixels);
+        r32 centre_y = origin_y - ((r32)rel_y * tile_side_in_pixels);
+        r32 min_x = first_centre_x - 0.5f * tile_side_in_pixels; 
+        r32 min_y = centre_y - 0.5f * tile_side_in_pixels; 
+        r32 max_x = last_centre_x + 0.5f * tile_side_in_pixels;
+        r32 max_y = centre_y + 0.5f * tile_side_in_pixels;
+
+        draw_rect(buffer, min_x, min_y, max_x, max_y, whitescale, whitescale, whitescale);
+
+        // NOTE(Ryan): The camera's tile is marked over its run
+        if (rel_y == 0 && first_rel_x <= 0 && last_rel_x >= 0)
+        {
+          draw_rect(buffer, origin_x - 0.5f * tile_side_in_pixels, min_y, 
+                    origin_x + 0.5f * tile_side_in_pixels, max_y, 0.0f, 0.0f, 0.0f);
+        }
+      }
+    }
+  }
+
+  END_TIMED_BLOCK(RENDER_TILE_LAYER);
+}
+
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): render_tile_layer() before chunk culling and runs. Bounds come from the buffer 
+// size alone, so they don't share the culling maths being checked
+INTERNAL void
+debug_render_tile_layer_per_tile(HHFBackBuffer *buffer, TileMap *tile_map, 
+                                 LoadedBitmap *backdrop, TileMapPosition *camera_pos, 
+                                 r32 tile_side_in_pixels)
+{
+  BEGIN_TIMED_BLOCK(RENDER_TILE_LAYER_PER_TILE);
+
+  buffer->num_dirty_rects = 0;
+
+  r32 screen_centre_x = (r32)buffer->width * 0.5f;
+  r32 screen_centre_y = (r32)buffer->height * 0.5f;
+  r32 metres_to_pixels = (r32)tile_side_in_pixels / (r32)tile_map->tile_side_in_metres;
+
+  draw_bmp(buffer, backdrop, 0.0f, 0.0f); 
+
+  r32 origin_x = screen_centre_x - (metres_to_pixels*camera_pos->x_offset);
+  r32 origin_y = screen_centre_y + (metres_to_pixels*camera_pos->y_offset);
+
+  s32 half_tiles_x = (s32)(screen_centre_x / tile_side_in_pixels) + 2;
+  s32 half_tiles_y = (s32)(screen_centre_y / tile_side_in_pixels) + 2;
+  for (s32 rel_y = -half_tiles_y; rel_y <= half_tiles_y; ++rel_y)
+  {
+    for (s32 rel_x = -half_tiles_x; rel_x <= half_tiles_x; ++rel_x)
+    {
+      u32 tile_x = camera_pos->abs_tile_x + rel_x;
+      u32 tile_y = camera_pos->abs_tile_y + rel_y;
+      u32 tile_id = get_tile_value(tile_map, tile_x, tile_y, camera_pos->abs_tile_z);
+      if (tile_id <= 1) continue;
+
+      r32 whitescale = 0.5f;
+      if (tile_id == 2) whitescale = 1.0f;
+      if (tile_id == 3 || tile_id == 4) whitescale = 0.25f;
+      if (rel_x == 0 && rel_y == 0) whitescale = 0.0f;
+
+      r32 centre_x = origin_x + ((r32)rel_x * tile_side_in_pixels);
+      r32 centre_y = origin_y - ((r32)rel_y * tile_side_in_pixels);
+      draw_rect(buffer, centre_x - 0.5f * tile_side_in_pixels, 
+                centre_y - 0.5f * tile_side_in_pixels, centre_x + 0.5f * tile_side_in_pixels, 
+                centre_y + 0.5f * tile_side_in_pixels, whitescale, whitescale, whitescale);
+    }
+  }
+
+  END_TIMED_BLOCK(RENDER_TILE_LAYER_PER_TILE);
+}
+
+// NOTE(Ryan): Buffer sizes and tile scales cycle with check_i. Cameras scatter around the 
+// real one, every eighth sitting on the world's low corner where chunk coordinates go negative
+INTERNAL void
+debug_check_tile_layer(TransientState *tran_state, TileMap *tile_map, LoadedBitmap *backdrop, 
+                       TileMapPosition *camera_pos, r32 tile_side_in_pixels, u32 check_i)
+{
+  HHFBackBuffer layer = tran_state->debug_check_buffers[0];
+  HHFBackBuffer reference = tran_state->debug_check_buffers[1];
+  int size_divisor = 1 + (check_i % 3);
+  layer.width = reference.width = layer.width / size_divisor + (size_divisor - 1);
+  layer.height = reference.height = layer.height / size_divisor + (size_divisor - 1);
+  u64 buffer_size = (u64)layer.width * layer.height * sizeof(u32);
+  memset(layer.memory, 0, buffer_size);
+  memset(reference.memory, 0, buffer_size);
+
+  r32 tile_scales[] = {1.0f, 0.5f, 0.125f, 2.0f, 0.2217f};
+  r32 check_tile_side_in_pixels = tile_side_in_pixels * 
+                                  tile_scales[(check_i / 3) % ARRAY_LEN(tile_scales)];
+
+  u32 hash = check_i * 2654435761u;
+  TileMapPosition camera = *camera_pos;
+  if (check_i % 8 == 0)
+  {
+    camera.abs_tile_x = hash % 3;
+    camera.abs_tile_y = (hash >> 8) % 3;
+  }
+  else
+  {
+    camera.abs_tile_x += (hash % 64) - 32;
+    camera.abs_tile_y += ((hash >> 8) % 64) - 32;
+  }
+  camera.x_offset = ((r32)((hash >> 16) % 101) / 100.0f - 0.5f) * tile_map->tile_side_in_metres;
+  camera.y_offset = ((r32)((hash >> 24) % 101) / 100.0f - 0.5f) * tile_map->tile_side_in_metres;
+
+  render_tile_layer(&layer, &tran_state->arena, tran_state->tile_draw_lists, tile_map, 
+                    backdrop, &camera, check_tile_side_in_pixels);
+  debug_render_tile_layer_per_tile(&reference, tile_map, backdrop, &camera, 
+                                   check_tile_side_in_pixels);
+
+  if (memcmp(layer.memory, reference.memory, buffer_size) != 0)
+  {
+    BP("Tile layer differs from per tile reference");
+  }
+}
+
+// NOTE(Ryan): draw_rect() before the SSE row fill, one store per pixel
+INTERNAL void
+debug_draw_rect_per_pixel(HHFBackBuffer *back_buffer, r32 x0, r32 y0, r32 x1, r32 y1, 
+                          r32 r, r32 g, r32 b)
+{
+  int min_x = roundf(x0);
+  int min_y = roundf(y0);
+  int max_x = roundf(x1);
+  int max_y = roundf(y1);
+
+  if (min_x < 0) min_x = 0;
+  if (min_x >= back_buffer->width) min_x = back_buffer->width;
+  if (max_x < 0) max_x = 0;
+  if (max_x >= back_buffer->width) max_x = back_buffer->width;
+
+  if (min_y < 0) min_y = 0;
+  if (min_y >= back_buffer->height) min_y = back_buffer->height;
+  if (max_y < 0) max_y = 0;
+  if (max_y >= back_buffer->height) max_y = back_buffer->height;
+
+  BEGIN_TIMED_BLOCK(DRAW_RECT_PER_PIXEL);
+
+  u32 colour = (u32)roundf(r * 255.0f) << 16 | 
+               (u32)roundf(g * 255.0f) << 8 | 
+               (u32)roundf(b * 255.0f);
+
+  for (int y = min_y; y < max_y; ++y)
+  {
+    for (int x = min_x; x < max_x; ++x)
+    {
+      u32 *pixel = (u32 *)back_buffer->memory + x + (y * back_buffer->width);
+      *pixel = colour;
+    }
+  }
+
+  END_TIMED_BLOCK_COUNTED(DRAW_RECT_PER_PIXEL, 
+                          (max_x > min_x && max_y > min_y) ? (max_x - min_x) * (max_y - min_y) : 0);
+}
+
+// NOTE(Ryan): A full buffer fill, then rects with fractional edges at every alignment, some 
+// hanging off or wholly outside the buffer
+INTERNAL void
+debug_check_draw_rect(TransientState *tran_state, u32 check_i)
+{
+  HHFBackBuffer *fill = &tran_state->debug_check_buffers[0];
+  HHFBackBuffer *reference = &tran_state->debug_check_buffers[1];
+  u64 buffer_size = (u64)fill->width * fill->height * sizeof(u32);
+
+  r32 full_shade = (r32)(check_i % 256) / 255.0f;
+  draw_rect(fill, 0.0f, 0.0f, (r32)fill->width, (r32)fill->height, 
+            full_shade, 1.0f - full_shade, 0.5f);
+  debug_draw_rect_per_pixel(reference, 0.0f, 0.0f, (r32)reference->width, (r32)reference->height, 
+                            full_shade, 1.0f - full_shade, 0.5f);
+
+  u32 seed = check_i * 2654435761u + 1;
+  for (int rect_i = 0; rect_i < 64; ++rect_i)
+  {
+    r32 coords[4] = {};
+    for (int coord_i = 0; coord_i < 4; ++coord_i)
+    {
+      seed = seed * 1664525 + 1013904223;
+      r32 extent = (coord_i % 2 == 0) ? (r32)fill->width : (r32)fill->height;
+      coords[coord_i] = ((r32)(seed >> 8) / (r32)(1 << 24)) * 1.2f * extent - 0.1f * extent;
+    }
+    r32 shade = (r32)(rect_i * 4) / 255.0f;
+    draw_rect(fill, coords[0], coords[1], coords[2], coords[3], shade, 0.25f, 1.0f - shade);
+    debug_draw_rect_per_pixel(reference, coords[0], coords[1], coords[2], coords[3], 
+                              shade, 0.25f, 1.0f - shade);
+  }
+
+  if (memcmp(fill->memory, reference->memory, buffer_size) != 0)
+  {
+    BP("draw_rect differs from per pixel reference");
+  }
+}
+
+// NOTE(Ryan): Text without the batch or spans, blending every pixel of each glyph's box
+INTERNAL void
+debug_draw_text_per_pixel(HHFBackBuffer *back_buffer, LoadedFont *font, int x, int y, 
+                          char *text)
+{
+  if (font->atlas.pixels == NULL) return;
+
+  BEGIN_TIMED_BLOCK(DRAW_TEXT_PER_PIXEL);
+
+  LoadedBitmap *atlas = &font->atlas;
+  u32 num_glyphs = 0;
+  int pen_x = x;
+  int pen_y = y;
+  for (char *at = text; *at != '\0'; ++at)
+  {
+    if (*at == '\n')
+    {
+      pen_x = x;
+      pen_y += font->line_height;
+      continue;
+    }
+
+    int glyph_i = *at - FONT_FIRST_CHAR;
+    if (glyph_i < 0 || glyph_i >= FONT_NUM_CHARS) glyph_i = '?' - FONT_FIRST_CHAR;
+
+    FontGlyph *glyph = &font->glyphs[glyph_i];
+    if (glyph->width > 0) num_glyphs++;
+    for (int glyph_y = 0; glyph_y < glyph->height; ++glyph_y)
+    {
+      int buffer_y = pen_y + glyph->offset_y + glyph_y;
+      if (buffer_y < 0 || buffer_y >= back_buffer->height) continue;
+
+      // NOTE(Ryan): Atlas is stored bottom-up
+      u32 *atlas_row = atlas->pixels + 
+                       (atlas->height - 1 - (glyph->atlas_row + glyph_y)) * atlas->width;
+      u32 *buffer_row = (u32 *)back_buffer->memory + (buffer_y * back_buffer->width);
+      for (int glyph_x = 0; glyph_x < glyph->width; ++glyph_x)
+      {
+        int buffer_x = pen_x + glyph->offset_x + glyph_x;
+        if (buffer_x < 0 || buffer_x >= back_buffer->width) continue;
+
+        buffer_row[buffer_x] = blend_pixel(buffer_row[buffer_x], atlas_row[glyph_x]);
+      }
+    }
+
+    pen_x += font->advance;
+  }
+
+  END_TIMED_BLOCK_COUNTED(DRAW_TEXT_PER_PIXEL, num_glyphs);
+}
+
+// NOTE(Ryan): Every printable character over a noisy background, on lines that run off each 
+// edge of the buffer so clipping is covered too
+INTERNAL void
+debug_check_text(TransientState *tran_state, LoadedFont *font, u32 check_i)
+{
+  HHFBackBuffer *batched = &tran_state->debug_check_buffers[0];
+  HHFBackBuffer *reference = &tran_state->debug_check_buffers[1];
+  u64 num_pixels = (u64)batched->width * batched->height;
+  for (u64 pixel_i = 0; pixel_i < num_pixels; ++pixel_i)
+  {
+    ((u32 *)batched->memory)[pixel_i] = ((u32)(pixel_i + check_i) * 2654435761u) >> 8;
+  }
+  memcpy(reference->memory, batched->memory, num_pixels * sizeof(u32));
+
+  char text['~' - ' ' + 2] = {};
+  for (char c = ' '; c <= '~'; ++c) text[c - ' '] = c;
+
+  TemporaryMemory temp_mem = begin_temporary_memory(&tran_state->arena);
+  TextBatch *batch = MEMORY_RESERVE_STRUCT(&tran_state->arena, TextBatch);
+  batch->num_glyphs = 0;
+
+  int num_lines = 8;
+  for (int line_i = 0; line_i < num_lines; ++line_i)
+  {
+    int line_x = (int)((line_i * 97 + check_i * 13) % (u32)(batched->width + 200)) - 300;
+    int line_y = -font->line_height / 2 + line_i * (batched->height / (num_lines - 1));
+    push_text(batch, font, line_x, line_y, text);
+    debug_draw_text_per_pixel(reference, font, line_x, line_y, text);
+  }
+  flush_text_batch(batched, batch, font);
+
+  end_temporary_memory(temp_mem);
+
+  if (!debug_are_pixels_same_colour(batched->memory, reference->memory, num_pixels))
+  {
+    BP("Batched text differs from per pixel reference");
+  }
+}
+
+// NOTE(Ryan): One configuration of each check per frame, so they can stay on whilst playing 
+INTERNAL void
+debug_run_render_checks(TransientState *tran_state, State *state, HHFBackBuffer *back_buffer, 
+                        r32 tile_side_in_pixels)
+{
+  // NOTE(Ryan): Memory is reserved at the largest back buffer size with the transient state
+  for (int buffer_i = 0; buffer_i < 2; ++buffer_i)
+  {
+    tran_state->debug_check_buffers[buffer_i].width = back_buffer->width;
+    tran_state->debug_check_buffers[buffer_i].height = back_buffer->height;
+  }
+
+  u32 check_i = tran_state->debug_check_i++;
+  debug_check_tile_layer(tran_state, state->world->tile_map, &state->backdrop, 
+                         &state->camera_pos, tile_side_in_pixels, check_i);
+  debug_check_draw_rect(tran_state, check_i);
+  debug_check_text(tran_state, &state->debug_font, check_i);
+}
+#endif
+
+// TODO(Ryan): Ensure game is procederal and rich in combinatorics
+INTERNAL void
+load_assets(HHFThreadContext *thread, HHFPlatform *platform, State *state)
+{
+  state->asset_arena.used = 0;
+
+  // TODO(Ryan): Not ideal to have large tables of strings in your code
+  char *hero_filenames[ARRAY_LEN(state->player_bitmaps)][3] = 
+  {
+    {"test/test_hero_right_head.bmp", "test/test_hero_right_cape.bmp", 
+     "test/test_hero_right_torso.bmp"},
+    {"test/test_hero_back_head.bmp", "test/test_hero_back_cape.bmp", 
+     "test/test_hero_back_torso.bmp"},
+    {"test/test_hero_left_head.bmp", "test/test_hero_left_cape.bmp", 
+     "test/test_hero_left_torso.bmp"},
+    {"test/test_hero_front_head.bmp", "test/test_hero_front_cape.bmp", 
+     "test/test_hero_front_torso.bmp"},
+  };
+
+  BitmapLoad loads[2 + 3 * ARRAY_LEN(state->player_bitmaps)] = {};
+  int num_loads = 0;
+
+  // IMPORTANT(Ryan): Working with artists, only specify that certain things need to be in different layers
+  loads[num_loads].bitmap = &state->backdrop;
+  loads[num_loads++].filename = "test/test_background.bmp";
+  for (uint player_bitmap_i = 0; player_bitmap_i < ARRAY_LEN(state->player_bitmaps); 
+       ++player_bitmap_i)
+  {
+    PlayerBitmap *player_bitmap = &state->player_bitmaps[player_bitmap_i];
+    player_bitmap->align_x = 72;
+    player_bitmap->align_y = 182;
+
+    loads[num_loads].bitmap = &player_bitmap->head;
+    loads[num_loads++].filename = hero_filenames[player_bitmap_i][0];
+    loads[num_loads].bitmap = &player_bitmap->torso;
+    loads[num_loads++].filename = hero_filenames[player_bitmap_i][1];
+    loads[num_loads].bitmap = &player_bitmap->legs;
+    loads[num_loads++].filename = hero_filenames[player_bitmap_i][2];
+  }
+
+  LoadedBitmap debug_font_sheet = {};
+  loads[num_loads].bitmap = &debug_font_sheet;
+  loads[num_loads++].filename = "test/debug_font.bmp";
+
+  load_bmps(thread, platform, &state->asset_arena, loads, num_loads);
+
+  if (debug_font_sheet.pixels == NULL) 
+  {
+    build_builtin_font_sheet(&state->asset_arena, &debug_font_sheet);
+  }
+  build_font_atlas(&state->asset_arena, &debug_font_sheet, &state->debug_font);
+}
+
+INTERNAL u32
+get_spatial_hash_cell(SpatialHash *hash, u32 origin_tile, r32 rel)
+{
+  // IMPORTANT(Ryan): Signed before the shift, so cells either side of the origin tile differ
+  s32 abs_tile = (s32)origin_tile + (s32)floorf(rel / hash->tile_side + 0.5f);
+  u32 result = (u32)(abs_tile >> SPATIAL_HASH_CELL_SHIFT);
+
+  return result;
+}
+
+INTERNAL u32
+get_spatial_hash_bucket(SpatialHash *hash, u32 cell_x, u32 cell_y, u32 abs_tile_z)
+{
+  u32 result = ((cell_x * 73856093U) ^ (cell_y * 19349663U) ^ (abs_tile_z * 83492791U)) & 
+               hash->bucket_mask;
+
+  return result;
+}
+
+INTERNAL SpatialHash *
+build_spatial_hash(MemoryArena *arena, TileMap *tile_map, TileMapPosition *origin, u32 count, 
+                   V2 *pos, u32 *abs_tile_z)
+{
+  SpatialHash *result = MEMORY_RESERVE_STRUCT(arena, SpatialHash);
+
+  result->origin = *origin;
+  result->tile_side = tile_map->tile_side_in_metres;
+  result->count = count;
+  result->pos = pos;
+
+  // NOTE(Ryan): At least twice as many buckets as entities keeps chains short
+  u32 num_buckets = 64;
+  while (num_buckets < 2 * count) num_buckets <<= 1;
+  result->bucket_mask = num_buckets - 1;
+  result->bucket_start = MEMORY_RESERVE_ARRAY(arena, num_buckets + 1, u32);
+  result->entries = MEMORY_RESERVE_ARRAY(arena, count, u32);
+  result->entry_cell_x = MEMORY_RESERVE_ARRAY(arena, count, u32);
+  result->entry_cell_y = MEMORY_RESERVE_ARRAY(arena, count, u32);
+  result->entry_pos = MEMORY_RESERVE_ARRAY(arena, count, V2);
+  result->entry_abs_tile_z = MEMORY_RESERVE_ARRAY(arena, count, u32);
+  u32 *entity_bucket = MEMORY_RESERVE_ARRAY(arena, count, u32);
+
+  memset(result->bucket_start, 0, (num_buckets + 1) * sizeof(u32));
+  for (u32 entity_i = 0; entity_i < count; ++entity_i)
+  {
+    u32 cell_x = get_spatial_hash_cell(result, origin->abs_tile_x, pos[entity_i].x);
+    u32 cell_y = get_spatial_hash_cell(result, origin->abs_tile_y, pos[entity_i].y);
+    entity_bucket[entity_i] = get_spatial_hash_bucket(result, cell_x, cell_y, 
+                                                      abs_tile_z[entity_i]);
+    result->bucket_start[entity_bucket[entity_i]] += 1;
+  }
+  // NOTE(Ryan): Inclusive prefix sum, so each bucket holds its end for now
+  for (u32 bucket_i = 1; bucket_i < num_buckets; ++bucket_i)
+  {
+    result->bucket_start[bucket_i] += result->bucket_start[bucket_i - 1];
+  }
+  result->bucket_start[num_buckets] = count;
+
+  // NOTE(Ryan): Scattering backwards counts each bucket's end down to its start, and keeps 
+  // entries in each bucket in ascending order
+  for (u32 entity_i = count; entity_i > 0; --entity_i)
+  {
+    u32 bucket = entity_bucket[entity_i - 1];
+    u32 entry_i = --result->bucket_start[bucket];
+    result->entries[entry_i] = entity_i - 1;
+    result->entry_cell_x[entry_i] = get_spatial_hash_cell(result, origin->abs_tile_x, 
+                                                          pos[entity_i - 1].x);
+    result->entry_cell_y[entry_i] = get_spatial_hash_cell(result, origin->abs_tile_y, 
+                                                          pos[entity_i - 1].y);
+    result->entry_pos[entry_i] = pos[entity_i - 1];
+    result->entry_abs_tile_z[entry_i] = abs_tile_z[entity_i - 1];
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Entities whose centre lies in [min, max] on floor abs_tile_z. Callers wanting 
+// box overlaps grow the query by the largest half size they care about
+INTERNAL u32
+query_spatial_hash_aabb(SpatialHash *hash, u32 abs_tile_z, V2 min, V2 max, 
+                        u32 *results, u32 max_results)
+{
+  u32 result = 0;
+
+  u32 min_cell_x = get_spatial_hash_cell(hash, hash->origin.abs_tile_x, min.x);
+  u32 max_cell_x = get_spatial_hash_cell(hash, hash->origin.abs_tile_x, max.x);
+  u32 min_cell_y = get_spatial_hash_cell(hash, hash->origin.abs_tile_y, min.y);
+  u32 max_cell_y = get_spatial_hash_cell(hash, hash->origin.abs_tile_y, max.y);
+
+  for (u32 cell_y = min_cell_y; cell_y != max_cell_y + 1; ++cell_y)
+  {
+    for (u32 cell_x = min_cell_x; cell_x != max_cell_x + 1; ++cell_x)
+    {
+      u32 bucket = get_spatial_hash_bucket(hash, cell_x, cell_y, abs_tile_z);
+      for (u32 entry_i = hash->bucket_start[bucket]; entry_i < hash->bucket_start[bucket + 1];
+           ++entry_i)
+      {
+        if (hash->entry_cell_x[entry_i] != cell_x || hash->entry_cell_y[entry_i] != cell_y) 
+        {
+          continue;
+        }
+
+        V2 pos = hash->entry_pos[entry_i];
+        if (hash->entry_abs_tile_z[entry_i] == abs_tile_z && 
+            pos.x >= min.x && pos.x <= max.x && pos.y >= min.y && pos.y <= max.y)
+        {
+          if (result == max_results) return result;
+          results[result++] = hash->entries[entry_i];
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+INTERNAL u32
+query_spatial_hash_radius(SpatialHash *hash, u32 abs_tile_z, V2 centre, r32 radius, 
+                          u32 *results, u32 max_results)
+{
+  u32 num_candidates = query_spatial_hash_aabb(hash, abs_tile_z, 
+                                               centre - v2(radius, radius), 
+                                               centre + v2(radius, radius), 
+                                               results, max_results);
+  u32 result = 0;
+  for (u32 candidate_i = 0; candidate_i < num_candidates; ++candidate_i)
+  {
+    u32 entity_i = results[candidate_i];
+    if (length_sq(hash->pos[entity_i] - centre) <= radius * radius)
+    {
+      results[result++] = entity_i;
+    }
+  }
+
+  return result;
+}
+
+#if defined(HHF_INTERNAL)
+INTERNAL void
+debug_fill_spatial_hash_population(MemoryArena *arena, u32 count, V2 **pos, u32 **abs_tile_z)
+{
+  *pos = MEMORY_RESERVE_ARRAY(arena, count, V2);
+  *abs_tile_z = MEMORY_RESERVE_ARRAY(arena, count, u32);
+
+  // NOTE(Ryan): Constant density, so per entity cost should stay flat as count grows
+  r32 side = sqrtf((r32)count / 0.25f);
+  u32 random_state = 0x9E3779B9;
+  for (u32 entity_i = 0; entity_i < count; ++entity_i)
+  {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    r32 x = (r32)(random_state & 0xFFFF) / 65535.0f;
+    r32 y = (r32)(random_state >> 16) / 65535.0f;
+    (*pos)[entity_i] = side * v2(x - 0.5f, y - 0.5f);
+    (*abs_tile_z)[entity_i] = 0;
+  }
+}
+
+INTERNAL u32
+debug_build_and_query_spatial_hash(MemoryArena *arena, TileMap *tile_map, u32 count, V2 *pos, 
+                                   u32 *abs_tile_z)
+{
+  TileMapPosition origin = {};
+  origin.abs_tile_x = 1 << 20;
+  origin.abs_tile_y = 1 << 20;
+  SpatialHash *hash = build_spatial_hash(arena, tile_map, &origin, count, pos, abs_tile_z);
+
+  u32 result = 0;
+  u32 neighbours[64];
+  for (u32 entity_i = 0; entity_i < count; ++entity_i)
+  {
+    result += query_spatial_hash_radius(hash, 0, pos[entity_i], 1.0f, neighbours, 
+                                        ARRAY_LEN(neighbours));
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Hits are entities, so equal cycles/hit across the three means linear scaling
+INTERNAL void
+debug_benchmark_spatial_hash(MemoryArena *arena, TileMap *tile_map)
+{
+  V2 *pos = NULL;
+  u32 *abs_tile_z = NULL;
+
+  TemporaryMemory benchmark_memory = begin_temporary_memory(arena);
+  debug_fill_spatial_hash_population(arena, 1000, &pos, &abs_tile_z);
+  BEGIN_TIMED_BLOCK(SPATIAL_HASH_1K);
+  debug_build_and_query_spatial_hash(arena, tile_map, 1000, pos, abs_tile_z);
+  END_TIMED_BLOCK_COUNTED(SPATIAL_HASH_1K, 1000);
+  end_temporary_memory(benchmark_memory);
+
+  benchmark_memory = begin_temporary_memory(arena);
+  debug_fill_spatial_hash_population(arena, 10000, &pos, &abs_tile_z);
+  BEGIN_TIMED_BLOCK(SPATIAL_HASH_10K);
+  debug_build_and_query_spatial_hash(arena, tile_map, 10000, pos, abs_tile_z);
+  END_TIMED_BLOCK_COUNTED(SPATIAL_HASH_10K, 10000);
+  end_temporary_memory(benchmark_memory);
+
+  benchmark_memory = begin_temporary_memory(arena);
+  debug_fill_spatial_hash_population(arena, 100000, &pos, &abs_tile_z);
+  BEGIN_TIMED_BLOCK(SPATIAL_HASH_100K);
+  debug_build_and_query_spatial_hash(arena, tile_map, 100000, pos, abs_tile_z);
+  END_TIMED_BLOCK_COUNTED(SPATIAL_HASH_100K, 100000);
+  end_temporary_memory(benchmark_memory);
+}
+
+// NOTE(Ryan): Both layouts side by side on a world sized grid of 128x128 chunks of 16x16 tiles, 
+// which is well past the L2 cache. Chunks sit back to back in chunk table order. Hits are 3x3 
+// neighbourhood queries, walking down columns as vertical scrolling does, then at random
+#define DEBUG_LAYOUT_CHUNKS_DIM 128
+#define DEBUG_LAYOUT_CHUNK_SHIFT 4
+
+INTERNAL u32
+debug_get_layout_tile_index(bool is_morton, u32 x, u32 y)
+{
+  u32 chunk_x = x >> DEBUG_LAYOUT_CHUNK_SHIFT;
+  u32 chunk_y = y >> DEBUG_LAYOUT_CHUNK_SHIFT;
+  u32 chunk_mask = (1U << DEBUG_LAYOUT_CHUNK_SHIFT) - 1;
+  u32 result = 0;
+
+  if (is_morton)
+  {
+    result = (morton_encode(chunk_x, chunk_y) << (2 * DEBUG_LAYOUT_CHUNK_SHIFT)) | 
+             morton_encode(x & chunk_mask, y & chunk_mask);
+  }
+  else
+  {
+    result = ((chunk_y * DEBUG_LAYOUT_CHUNKS_DIM + chunk_x) << (2 * DEBUG_LAYOUT_CHUNK_SHIFT)) | 
+             ((y & chunk_mask) << DEBUG_LAYOUT_CHUNK_SHIFT) | (x & chunk_mask);
+  }
+
+  return result;
+}
+
+INTERNAL u32
+debug_query_tile_neighbourhoods(u32 *tiles, bool is_morton, u32 *query_x, u32 *query_y, 
+                                u32 num_queries)
+{
+  u32 result = 0;
+
+  for (u32 query_i = 0; query_i < num_queries; ++query_i)
+  {
+    for (u32 y = query_y[query_i] - 1; y <= query_y[query_i] + 1; ++y)
+    {
+      for (u32 x = query_x[query_i] - 1; x <= query_x[query_i] + 1; ++x)
+      {
+        result += tiles[debug_get_layout_tile_index(is_morton, x, y)];
+      }
+    }
+  }
+
+  return result;
+}
+
+INTERNAL void
+debug_benchmark_tile_layouts(MemoryArena *arena)
+{
+  u32 world_dim = DEBUG_LAYOUT_CHUNKS_DIM << DEBUG_LAYOUT_CHUNK_SHIFT;
+  u32 num_tiles = world_dim * world_dim;
+  u32 num_queries = 1 << 20;
+  u32 random_state = 0x1F123BB5;
+
+  TemporaryMemory benchmark_memory = begin_temporary_memory(arena);
+  u32 *row_major_tiles = MEMORY_RESERVE_ARRAY(arena, num_tiles, u32);
+  u32 *morton_tiles = MEMORY_RESERVE_ARRAY(arena, num_tiles, u32);
+  for (u32 y = 0; y < world_dim; ++y)
+  {
+    for (u32 x = 0; x < world_dim; ++x)
+    {
+      u32 tile_value = 1 + (debug_random_u32(&random_state) & 1);
+      row_major_tiles[debug_get_layout_tile_index(false, x, y)] = tile_value;
+      morton_tiles[debug_get_layout_tile_index(true, x, y)] = tile_value;
+    }
+  }
+
+  // NOTE(Ryan): Queries stay a tile in from the edge so neighbourhoods never leave the grid
+  u32 *query_x = MEMORY_RESERVE_ARRAY(arena, num_queries, u32);
+  u32 *query_y = MEMORY_RESERVE_ARRAY(arena, num_queries, u32);
+  for (u32 query_i = 0; query_i < num_queries; ++query_i)
+  {
+    query_x[query_i] = 1 + (query_i / (world_dim - 2)) * 37 % (world_dim - 2);
+    query_y[query_i] = 1 + query_i % (world_dim - 2);
+  }
+
+  BEGIN_TIMED_BLOCK(TILE_LAYOUT_ROW_MAJOR_COLUMNS);
+  u32 row_major_sum = debug_query_tile_neighbourhoods(row_major_tiles, false, query_x, query_y, 
+                                                      num_queries);
+  END_TIMED_BLOCK_COUNTED(TILE_LAYOUT_ROW_MAJOR_COLUMNS, num_queries);
+
+  BEGIN_TIMED_BLOCK(TILE_LAYOUT_MORTON_COLUMNS);
+  u32 morton_sum = debug_query_tile_neighbourhoods(morton_tiles, true, query_x, query_y, 
+                                                   num_queries);
+  END_TIMED_BLOCK_COUNTED(TILE_LAYOUT_MORTON_COLUMNS, num_queries);
+
+  if (row_major_sum != morton_sum) BP("Tile layouts disagree");
+
+  for (u32 query_i = 0; query_i < num_queries; ++query_i)
+  {
+    query_x[query_i] = 1 + debug_random_u32(&random_state) % (world_dim - 2);
+    query_y[query_i] = 1 + debug_random_u32(&random_state) % (world_dim - 2);
+  }
+
+  BEGIN_TIMED_BLOCK(TILE_LAYOUT_ROW_MAJOR_RANDOM);
+  row_major_sum = debug_query_tile_neighbourhoods(row_major_tiles, false, query_x, query_y, 
+                                                  num_queries);
+  END_TIMED_BLOCK_COUNTED(TILE_LAYOUT_ROW_MAJOR_RANDOM, num_queries);
+
+  BEGIN_TIMED_BLOCK(TILE_LAYOUT_MORTON_RANDOM);
+  morton_sum = debug_query_tile_neighbourhoods(morton_tiles, true, query_x, query_y, 
+                                               num_queries);
+  END_TIMED_BLOCK_COUNTED(TILE_LAYOUT_MORTON_RANDOM, num_queries);
+
+  if (row_major_sum != morton_sum) BP("Tile layouts disagree");
+
+  end_temporary_memory(benchmark_memory);
+}
+
+// NOTE(Ryan): Run once per F3 press, as each benchmark works through tens of MB. Only the 
+// counters they moved are kept for the overlay
+INTERNAL void
+debug_run_benchmarks(TransientState *tran_state, HHFMemory *memory, TileMap *tile_map)
+{
+  HHFDebugCycleCounter counters_before[DEBUG_CYCLE_COUNTER_COUNT];
+  memcpy(counters_before, memory->debug_cycle_counters, sizeof(counters_before));
+
+  debug_benchmark_spatial_hash(&tran_state->arena, tile_map);
+  tran_state->debug_num_precision_failures = 
+    debug_check_position_precision(&tran_state->arena, tile_map, 
+                                   &tran_state->debug_num_precision_checks);
+  debug_benchmark_position_batches(&tran_state->arena, tile_map);
+  debug_benchmark_tile_layouts(&tran_state->arena);
+
+  for (int counter_i = 0; counter_i < DEBUG_CYCLE_COUNTER_COUNT; ++counter_i)
+  {
+    HHFDebugCycleCounter *counter = &memory->debug_cycle_counters[counter_i];
+    HHFDebugCycleCounter *benchmark_counter = &tran_state->debug_benchmark_counters[counter_i];
+    *benchmark_counter = {};
+    if (counter->hit_count != counters_before[counter_i].hit_count)
+    {
+      benchmark_counter->cycle_count = counter->cycle_count - counters_before[counter_i].cycle_count;
+      benchmark_counter->hit_count = counter->hit_count - counters_before[counter_i].hit_count;
+    }
+  }
+}
+#endif
+
+INTERNAL u32
+get_flow_field_index(FlowField *field, TileMap *tile_map, u32 local_x, u32 local_y, u32 z)
+{
+  u32 chunk_i = (z * FLOW_FIELD_CHUNKS_DIM + (local_y >> tile_map->chunk_shift)) * 
+                  FLOW_FIELD_CHUNKS_DIM + (local_x >> tile_map->chunk_shift);
+  u32 result = chunk_i * field->tiles_per_chunk + 
+               (local_y & tile_map->chunk_mask) * tile_map->chunk_dim + 
+               (local_x & tile_map->chunk_mask);
+
+  return result;
+}
+
+// NOTE(Ryan): Window relative tile coordinates, false if outside the window
+INTERNAL bool
+get_flow_field_local(FlowField *field, TileMap *tile_map, u32 abs_tile_x, u32 abs_tile_y, 
+                     u32 *local_x, u32 *local_y)
+{
+  s32 window_dim = FLOW_FIELD_CHUNKS_DIM * tile_map->chunk_dim;
+  s32 x = (s32)abs_tile_x - (field->min_chunk_x << tile_map->chunk_shift);
+  s32 y = (s32)abs_tile_y - (field->min_chunk_y << tile_map->chunk_shift);
+
+  bool result = (x >= 0 && x < window_dim && y >= 0 && y < window_dim);
+  *local_x = (u32)x;
+  *local_y = (u32)y;
+
+  return result;
+}
+
+INTERNAL bool
+is_flow_field_working_door(FlowField *field, TileMap *tile_map, u32 local_x, u32 local_y, 
+                           u32 z, u32 *to_z)
+{
+  bool result = false;
+
+  u32 tile_value = field->tile_value[get_flow_field_index(field, tile_map, local_x, local_y, z)];
+  if (tile_value == 3 && (s32)z + 1 < field->num_chunks_z)
+  {
+    *to_z = z + 1;
+    result = true;
+  }
+  if (tile_value == 4 && z > 0)
+  {
+    *to_z = z - 1;
+    result = true;
+  }
+  if (result)
+  {
+    u32 to_index = get_flow_field_index(field, tile_map, local_x, local_y, *to_z);
+    result = is_tile_value_empty(field->tile_value[to_index]);
+  }
+
+  return result;
+}
+
+GLOBAL s32 global_flow_direction_dx[] = {0, 1, 0, -1, 0};
+GLOBAL s32 global_flow_direction_dy[] = {0, 0, 1, 0, -1};
+
+// NOTE(Ryan): Reached from step_to, so tiles point back along a shortest path
+INTERNAL void
+relax_flow_field_neighbours(FlowField *field, TileMap *tile_map, u32 step_to_x, u32 step_to_y,
+                            u32 z, u16 distance, u32 *queue_end)
+{
+  u32 window_dim = FLOW_FIELD_CHUNKS_DIM * tile_map->chunk_dim;
+  for (int direction = FLOW_DIRECTION_RIGHT; direction <= FLOW_DIRECTION_DOWN; ++direction)
+  {
+    // NOTE(Ryan): Going the opposite way from the neighbour gets back to step_to
+    u32 x = step_to_x - global_flow_direction_dx[direction];
+    u32 y = step_to_y - global_flow_direction_dy[direction];
+    if (x >= window_dim || y >= window_dim) continue;
+
+    u32 index = get_flow_field_index(field, tile_map, x, y, z);
+    if (field->distance[index] != FLOW_FIELD_UNREACHABLE || 
+        !is_tile_value_empty(field->tile_value[index])) 
+    {
+      continue;
+    }
+
+    field->distance[index] = distance;
+    field->direction[index] = (u8)direction;
+    field->queue[(*queue_end)++] = x | (y << 10) | (z << 20);
+  }
+}
+
+// NOTE(Ryan): Breadth first outwards from all targets at once. An agent stepping onto a 
+// working door lands on the other floor, so a tile is entered from its neighbours unless it is
+// a door, and also from the neighbours of any door landing on it
+INTERNAL void
+build_flow_field(FlowField *field, TileMap *tile_map)
+{
+  BEGIN_TIMED_BLOCK(BUILD_FLOW_FIELD);
+
+  s32 centre_chunk_x = (s32)(field->targets[0].abs_tile_x >> tile_map->chunk_shift);
+  s32 centre_chunk_y = (s32)(field->targets[0].abs_tile_y >> tile_map->chunk_shift);
+  field->min_chunk_x = centre_chunk_x - FLOW_FIELD_CHUNKS_DIM / 2;
+  field->min_chunk_y = centre_chunk_y - FLOW_FIELD_CHUNKS_DIM / 2;
+
+  for (s32 z = 0; z < field->num_chunks_z; ++z)
+  {
+    for (s32 chunk_y = 0; chunk_y < FLOW_FIELD_CHUNKS_DIM; ++chunk_y)
+    {
+      for (s32 chunk_x = 0; chunk_x < FLOW_FIELD_CHUNKS_DIM; ++chunk_x)
+      {
+        u32 chunk_i = (z * FLOW_FIELD_CHUNKS_DIM + chunk_y) * FLOW_FIELD_CHUNKS_DIM + chunk_x;
+        u8 *tile_value = field->tile_value + chunk_i * field->tiles_per_chunk;
+        TileChunk *tile_chunk = get_tile_chunk(tile_map, field->min_chunk_x + chunk_x,
+                                               field->min_chunk_y + chunk_y, z);
+        if (tile_chunk != NULL && tile_chunk->tiles != NULL)
+        {
+          // NOTE(Ryan): The window is row-major whatever the tile map's layout
+          for (u32 tile_y = 0; tile_y < tile_map->chunk_dim; ++tile_y)
+          {
+            for (u32 tile_x = 0; tile_x < tile_map->chunk_dim; ++tile_x)
+            {
+              tile_value[tile_y * tile_map->chunk_dim + tile_x] = 
+                (u8)get_tile_value_unchecked(tile_map, tile_chunk, tile_x, tile_y);
+            }
+          }
+        }
+        else
+        {
+          memset(tile_value, 0, field->tiles_per_chunk);
+        }
+      }
+    }
+  }
+
+  u32 num_window_tiles = FLOW_FIELD_CHUNKS_DIM * FLOW_FIELD_CHUNKS_DIM * field->num_chunks_z *
+                         field->tiles_per_chunk;
+  memset(field->distance, 0xFF, num_window_tiles * sizeof(u16));
+  memset(field->direction, FLOW_DIRECTION_NONE, num_window_tiles);
+
+  u32 queue_start = 0;
+  u32 queue_end = 0;
+  for (u32 target_i = 0; target_i < field->num_targets; ++target_i)
+  {
+    TileMapPosition *target = &field->targets[target_i];
+    u32 local_x = 0;
+    u32 local_y = 0;
+    if (get_flow_field_local(field, tile_map, target->abs_tile_x, target->abs_tile_y, 
+                             &local_x, &local_y) && 
+        (s32)target->abs_tile_z < field->num_chunks_z)
+    {
+      u32 index = get_flow_field_index(field, tile_map, local_x, local_y, target->abs_tile_z);
+      if (field->distance[index] == FLOW_FIELD_UNREACHABLE && 
+          is_tile_value_empty(field->tile_value[index]))
+      {
+        field->distance[index] = 0;
+        field->queue[queue_end++] = local_x | (local_y << 10) | (target->abs_tile_z << 20);
+      }
+    }
+  }
+
+  while (queue_start < queue_end)
+  {
+    u32 packed = field->queue[queue_start++];
+    u32 x = packed & 0x3FF;
+    u32 y = (packed >> 10) & 0x3FF;
+    u32 z = packed >> 20;
+    u16 popped_distance = field->distance[get_flow_field_index(field, tile_map, x, y, z)];
+    u16 distance = popped_distance + 1;
+
+    // NOTE(Ryan): A target on a door is still where agents want to get to
+    u32 door_to_z = 0;
+    if (popped_distance == 0 || 
+        !is_flow_field_working_door(field, tile_map, x, y, z, &door_to_z))
+    {
+      relax_flow_field_neighbours(field, tile_map, x, y, z, distance, &queue_end);
+    }
+    for (s32 door_z = (s32)z - 1; door_z <= (s32)z + 1; door_z += 2)
+    {
+      if (door_z < 0 || door_z >= field->num_chunks_z) continue;
+      if (is_flow_field_working_door(field, tile_map, x, y, door_z, &door_to_z) && 
+          door_to_z == z)
+      {
+        relax_flow_field_neighbours(field, tile_map, x, y, door_z, distance, &queue_end);
+      }
+    }
+  }
+
+  END_TIMED_BLOCK_COUNTED(BUILD_FLOW_FIELD, queue_end);
+}
+
+// NOTE(Ryan): Only rebuilt when a target moves to another tile or the tiles change
+INTERNAL void
+update_flow_field(MemoryArena *arena, FlowField *field, TileMap *tile_map, 
+                  TileMapPosition *targets, u32 num_targets)
+{
+  ASSERT(num_targets > 0 && num_targets <= FLOW_FIELD_MAX_TARGETS);
+
+  if (field->tile_value == NULL)
+  {
+    field->num_chunks_z = tile_map->num_tile_chunks_z;
+    field->tiles_per_chunk = tile_map->chunk_dim * tile_map->chunk_dim;
+    u32 num_window_tiles = FLOW_FIELD_CHUNKS_DIM * FLOW_FIELD_CHUNKS_DIM * 
+                           field->num_chunks_z * field->tiles_per_chunk;
+    field->tile_value = MEMORY_RESERVE_ARRAY(arena, num_window_tiles, u8);
+    field->distance = MEMORY_RESERVE_ARRAY(arena, num_window_tiles, u16);
+    field->direction = MEMORY_RESERVE_ARRAY(arena, num_window_tiles, u8);
+    field->queue = MEMORY_RESERVE_ARRAY(arena, num_window_tiles, u32);
+  }
+
+  bool targets_changed = (field->num_targets != num_targets);
+  for (u32 target_i = 0; target_i < num_targets && !targets_changed; ++target_i)
+  {
+    targets_changed = !are_on_same_tile(&field->targets[target_i], &targets[target_i]);
+  }
+
+  if (!field->is_valid || targets_changed || field->tile_generation != tile_map->tile_generation)
+  {
+    field->num_targets = num_targets;
+    for (u32 target_i = 0; target_i < num_targets; ++target_i)
+    {
+      field->targets[target_i] = targets[target_i];
+    }
+    field->tile_generation = tile_map->tile_generation;
+
+    build_flow_field(field, tile_map);
+    field->is_valid = true;
+  }
+}
+
+// NOTE(Ryan): FLOW_DIRECTION_NONE when on a target, unreachable or outside the window
+INTERNAL FLOW_DIRECTION
+get_flow_direction(FlowField *field, TileMap *tile_map, u32 abs_tile_x, u32 abs_tile_y, 
+                   u32 abs_tile_z, u16 *distance)
+{
+  FLOW_DIRECTION result = FLOW_DIRECTION_NONE;
+  *distance = FLOW_FIELD_UNREACHABLE;
+
+  u32 local_x = 0;
+  u32 local_y = 0;
+  if (field->is_valid && (s32)abs_tile_z < field->num_chunks_z &&
+      get_flow_field_local(field, tile_map, abs_tile_x, abs_tile_y, &local_x, &local_y))
+  {
+    u32 index = get_flow_field_index(field, tile_map, local_x, local_y, abs_tile_z);
+    *distance = field->distance[index];
+    result = (FLOW_DIRECTION)field->direction[index];
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Each connected controller adds its own push
+INTERNAL V2
+get_player_velocity(State *state, HHFInputController *controller)
+{
+  V2 result = {};
+
+  if (controller->action_right.ended_down) 
+  {
+    state->player_facing_direction = 0;
+    result.x = 1.0f;
+  }
+  if (controller->action_up.ended_down) 
+  {
+    state->player_facing_direction = 1;
+    result.y = 1.0f; 
+  }
+  if (controller->action_left.ended_down) 
+  {
+    state->player_facing_direction = 2;
+    result.x = -1.0f;
+  }
+  if (controller->action_down.ended_down) 
+  {
+    state->player_facing_direction = 3;
+    result.y = -1.0f;
+  }
+
+  r32 player_speed = 2.0f;
+
+  if (controller->move_down.ended_down) player_speed = 10.0f;
+
+  result *= player_speed;
+
+  return result;
+}
+
+INTERNAL void
+update_camera(State *state, TileMap *tile_map)
+{
+  TileMapPosition player_pos = get_entity_pos(state->entities, 
+                                              get_entity_index(state->entities, state->player));
+  state->camera_pos.abs_tile_z = player_pos.abs_tile_z;
+
+  TileMapDifference diff = subtract(tile_map, &player_pos, &state->camera_pos);
+
+  // NOTE(Ryan): Screens are 17 / 9, so half screen widths
+  if (diff.dx > (9.0f * tile_map->tile_side_in_metres))
+  {
+    state->camera_pos.abs_tile_x += 17;
+  }
+  if (diff.dx < -(9.0f * tile_map->tile_side_in_metres))
+  {
+    state->camera_pos.abs_tile_x -= 17;
+  }
+  if (diff.dy > (5.0f * tile_map->tile_side_in_metres))
+  {
+    state->camera_pos.abs_tile_y += 9;
+  }
+  if (diff.dy < -(5.0f * tile_map->tile_side_in_metres))
+  {
+    state->camera_pos.abs_tile_y -= 9;
+  }
+}
+
+INTERNAL void
+simulate_entities(MemoryArena *arena, SimRegion *region, TileMap *tile_map, 
+                  FlowField *flow_field, r32 dt)
+{
+  BEGIN_TIMED_BLOCK(SIMULATE_ENTITIES);
+
+  SpatialHash *hash = build_spatial_hash(arena, tile_map, &region->origin, region->count, 
+                                         region->pos, region->abs_tile_z);
+  r32 max_half_dim = 0.0f;
+  for (u32 sim_i = 0; sim_i < region->count; ++sim_i)
+  {
+    max_half_dim = MAX(max_half_dim, region->half_dim[sim_i].x);
+    max_half_dim = MAX(max_half_dim, region->half_dim[sim_i].y);
+  }
+
+  for (u32 sim_i = 0; sim_i < region->count; ++sim_i)
+  {
+    // NOTE(Ryan): Monsters close enough to the player head for the next tile on the flow 
+    // field, and stop on reaching the player. Otherwise they keep wandering
+    if (region->type[sim_i] == ENTITY_TYPE_MONSTER)
+    {
+      V2 pos = region->pos[sim_i];
+      r32 tile_side = tile_map->tile_side_in_metres;
+      u32 abs_tile_x = region->origin.abs_tile_x + (s32)floorf(pos.x / tile_side + 0.5f);
+      u32 abs_tile_y = region->origin.abs_tile_y + (s32)floorf(pos.y / tile_side + 0.5f);
+      u16 distance = 0;
+      FLOW_DIRECTION direction = get_flow_direction(flow_field, tile_map, abs_tile_x, abs_tile_y,
+                                                    region->abs_tile_z[sim_i], &distance);
+      if (distance == 0)
+      {
+        region->velocity[sim_i] = v2(0.0f, 0.0f);
+      }
+      else if (distance <= 20 && direction != FLOW_DIRECTION_NONE)
+      {
+        V2 next_tile_pos = 
+          tile_side * v2((r32)(s32)(abs_tile_x + global_flow_direction_dx[direction] - 
+                                    region->origin.abs_tile_x),
+                         (r32)(s32)(abs_tile_y + global_flow_direction_dy[direction] - 
+                                    region->origin.abs_tile_y));
+        V2 to_next_tile = next_tile_pos - pos;
+        region->velocity[sim_i] = (1.5f / sqrtf(length_sq(to_next_tile))) * to_next_tile;
+      }
+    }
+
+    V2 velocity = region->velocity[sim_i];
+    if (velocity.x == 0.0f && velocity.y == 0.0f) continue;
+
+    // NOTE(Ryan): Monsters turn away from anything their box overlaps that they are heading 
+    // towards. Entities already moved this tick are still filed under their old cell, which 
+    // is close enough to steer by
+    if (region->type[sim_i] == ENTITY_TYPE_MONSTER)
+    {
+      V2 pos = region->pos[sim_i];
+      V2 half_dim = region->half_dim[sim_i];
+      V2 query_radius = half_dim + v2(max_half_dim, max_half_dim);
+      u32 neighbours[32];
+      u32 num_neighbours = query_spatial_hash_aabb(hash, region->abs_tile_z[sim_i], 
+                                                   pos - query_radius, pos + query_radius,
+                                                   neighbours, ARRAY_LEN(neighbours));
+      for (u32 neighbour_i = 0; neighbour_i < num_neighbours; ++neighbour_i)
+      {
+        u32 other_i = neighbours[neighbour_i];
+        if (other_i == sim_i) continue;
+
+        V2 separation = pos - region->pos[other_i];
+        V2 overlap_dim = half_dim + region->half_dim[other_i];
+        if (fabsf(separation.x) < overlap_dim.x && fabsf(separation.y) < overlap_dim.y &&
+            dot(velocity, separation) < 0.0f)
         {
-          int abs_tile_x = screen_x * num_tiles_screen_x + tile_x;
-          int abs_tile_y = screen_y * num_tiles_screen_y + tile_y;
+          V2 away = (1.0f / sqrtf(length_sq(separation))) * separation;
+          velocity -= 2.0f * dot(velocity, away) * away;
+        }
+      }
+      region->velocity[sim_i] = velocity;
+    }
+
+    SweepResult hit = move_sim_entity(region, tile_map, sim_i, dt * velocity);
+
+    // NOTE(Ryan): Monsters bounce off walls, keeping their speed
+    if (hit.t < 1.0f && region->type[sim_i] == ENTITY_TYPE_MONSTER)
+    {
+      region->velocity[sim_i] = velocity - 2.0f * dot(velocity, hit.wall_normal) * hit.wall_normal;
+    }
+  }
+
+  END_TIMED_BLOCK_COUNTED(SIMULATE_ENTITIES, region->count);
+}
+
+// NOTE(Ryan): Little endian as written. Fields sit at their natural alignment and chunk tiles
+// are 64 byte aligned, so a mapped save is used in place rather than deserialised
+#define WORLD_SAVE_FILE_NAME "world.hhfsave"
+#define WORLD_SAVE_MAGIC 0x56534848
+#define WORLD_SAVE_VERSION 1
+
+// NOTE(Ryan): Chunk indices and tiles are saved as laid out in memory, so only load in a build
+// with the same layout
+#define WORLD_SAVE_FLAG_MORTON_LAYOUT 0x1
+#if defined(HHF_MORTON_LAYOUT)
+#define WORLD_SAVE_LAYOUT_FLAGS WORLD_SAVE_FLAG_MORTON_LAYOUT
+#else
+#define WORLD_SAVE_LAYOUT_FLAGS 0
+#endif
+
+struct WorldSaveHeader
+{
+  u32 magic;
+  u32 version;
+  u32 header_size;
+  u32 flags;
+
+  u32 chunk_shift;
+  s32 num_tile_chunks_x;
+  s32 num_tile_chunks_y;
+  s32 num_tile_chunks_z;
+  r32 tile_side_in_metres;
+
+  u32 num_chunks;
+  u64 chunk_index_offset;
+  u32 num_entities;
+  u32 player_entity_i;
+  u64 entities_offset;
+
+  u32 camera_abs_tile_x;
+  u32 camera_abs_tile_y;
+  u32 camera_abs_tile_z;
+  r32 camera_x_offset;
+  r32 camera_y_offset;
+  s32 player_facing_direction;
+};
+
+// NOTE(Ryan): Only chunks with tiles are saved
+struct WorldSaveChunk
+{
+  u32 chunk_i;
+  u32 reserved;
+  u64 tiles_offset;
+};
+
+struct WorldSaveEntity
+{
+  u32 type;
+  u32 abs_tile_x;
+  u32 abs_tile_y;
+  u32 abs_tile_z;
+  r32 x_offset;
+  r32 y_offset;
+  V2 velocity;
+  V2 half_dim;
+};
+
+INTERNAL u64
+align_u64(u64 value, u64 alignment)
+{
+  u64 result = (value + alignment - 1) & ~(alignment - 1);
+
+  return result;
+}
+
+INTERNAL u64
+get_world_save_size(State *state)
+{
+  TileMap *tile_map = state->world->tile_map;
+
+  u32 num_saved_chunks = 0;
+  for (u32 chunk_i = 0; chunk_i < get_num_tile_chunks(tile_map); ++chunk_i)
+  {
+    if (tile_map->chunks[chunk_i].tiles != NULL) num_saved_chunks += 1;
+  }
+
+  u64 result = sizeof(WorldSaveHeader) + num_saved_chunks * sizeof(WorldSaveChunk) + 
+               state->entities->count * sizeof(WorldSaveEntity);
+  result = align_u64(result, 64);
+  result += (u64)num_saved_chunks * tile_map->chunk_dim * tile_map->chunk_dim * sizeof(u32);
+
+  return result;
+}
 
-          u32 tile_value = 1;
-          if (tile_x == 0 || tile_x == num_tiles_screen_x - 1) 
-          {
-            // NOTE(Ryan): Although de morgan's laws could be used to reduce the number of
-            // boolean expressions, often best to make clear linguistically
-            if (tile_y != num_tiles_screen_y / 2) tile_value = 2;
-          }
-          if (tile_y == 0 || tile_y == num_tiles_screen_y - 1) 
+// NOTE(Ryan): Every chunk with tiles and every entity slot used
+INTERNAL u64
+get_max_world_save_size(TileMap *tile_map)
+{
+  u32 num_tile_chunks = get_num_tile_chunks(tile_map);
+
+  u64 result = sizeof(WorldSaveHeader) + num_tile_chunks * sizeof(WorldSaveChunk) + 
+               MAX_ENTITIES * sizeof(WorldSaveEntity);
+  result = align_u64(result, 64);
+  result += (u64)num_tile_chunks * tile_map->chunk_dim * tile_map->chunk_dim * sizeof(u32);
+
+  return result;
+}
+
+// NOTE(Ryan): dest must hold get_world_save_size() bytes
+INTERNAL u64
+save_world(State *state, u8 *dest)
+{
+  TileMap *tile_map = state->world->tile_map;
+  EntityStore *entities = state->entities;
+  u64 chunk_tiles_size = tile_map->chunk_dim * tile_map->chunk_dim * sizeof(u32);
+
+  WorldSaveHeader *header = (WorldSaveHeader *)dest;
+  *header = {};
+  header->magic = WORLD_SAVE_MAGIC;
+  header->version = WORLD_SAVE_VERSION;
+  header->header_size = sizeof(WorldSaveHeader);
+  header->flags = WORLD_SAVE_LAYOUT_FLAGS;
+  header->chunk_shift = tile_map->chunk_shift;
+  header->num_tile_chunks_x = tile_map->num_tile_chunks_x;
+  header->num_tile_chunks_y = tile_map->num_tile_chunks_y;
+  header->num_tile_chunks_z = tile_map->num_tile_chunks_z;
+  header->tile_side_in_metres = tile_map->tile_side_in_metres;
+  header->camera_abs_tile_x = state->camera_pos.abs_tile_x;
+  header->camera_abs_tile_y = state->camera_pos.abs_tile_y;
+  header->camera_abs_tile_z = state->camera_pos.abs_tile_z;
+  header->camera_x_offset = state->camera_pos.x_offset;
+  header->camera_y_offset = state->camera_pos.y_offset;
+  header->player_facing_direction = state->player_facing_direction;
+
+  for (u32 chunk_i = 0; chunk_i < get_num_tile_chunks(tile_map); ++chunk_i)
+  {
+    if (tile_map->chunks[chunk_i].tiles != NULL) header->num_chunks += 1;
+  }
+  header->chunk_index_offset = sizeof(WorldSaveHeader);
+  header->num_entities = entities->count;
+  header->player_entity_i = get_entity_index(entities, state->player);
+  header->entities_offset = header->chunk_index_offset + 
+                            header->num_chunks * sizeof(WorldSaveChunk);
+
+  WorldSaveEntity *saved_entities = (WorldSaveEntity *)(dest + header->entities_offset);
+  for (u32 entity_i = 0; entity_i < entities->count; ++entity_i)
+  {
+    WorldSaveEntity *saved_entity = &saved_entities[entity_i];
+    saved_entity->type = entities->type[entity_i];
+    saved_entity->abs_tile_x = entities->abs_tile_x[entity_i];
+    saved_entity->abs_tile_y = entities->abs_tile_y[entity_i];
+    saved_entity->abs_tile_z = entities->abs_tile_z[entity_i];
+    saved_entity->x_offset = entities->x_offset[entity_i];
+    saved_entity->y_offset = entities->y_offset[entity_i];
+    saved_entity->velocity = entities->velocity[entity_i];
+    saved_entity->half_dim = entities->half_dim[entity_i];
+  }
+
+  u64 result = align_u64(header->entities_offset + entities->count * sizeof(WorldSaveEntity), 
+                         64);
+  memset(dest + header->entities_offset + entities->count * sizeof(WorldSaveEntity), 0,
+         result - (header->entities_offset + entities->count * sizeof(WorldSaveEntity)));
+
+  WorldSaveChunk *saved_chunk = (WorldSaveChunk *)(dest + header->chunk_index_offset);
+  for (u32 chunk_i = 0; chunk_i < get_num_tile_chunks(tile_map); ++chunk_i)
+  {
+    TileChunk *tile_chunk = &tile_map->chunks[chunk_i];
+    if (tile_chunk->tiles != NULL)
+    {
+      saved_chunk->chunk_i = chunk_i;
+      saved_chunk->reserved = 0;
+      saved_chunk->tiles_offset = result;
+      memcpy(dest + result, tile_chunk->tiles, chunk_tiles_size);
+
+      result += chunk_tiles_size;
+      saved_chunk += 1;
+    }
+  }
+
+  return result;
+}
+
+INTERNAL bool
+is_file_range_valid(u64 file_size, u64 offset, u64 size, u64 alignment)
+{
+  bool result = ((offset & (alignment - 1)) == 0 && offset <= file_size && 
+                 size <= file_size - offset);
+
+  return result;
+}
+
+INTERNAL bool
+is_world_save_valid(HHFPlatformMappedFile *save, u64 max_num_tile_chunks)
+{
+  u8 *base = (u8 *)save->memory;
+  WorldSaveHeader *header = (WorldSaveHeader *)base;
+
+  if (save->size < sizeof(WorldSaveHeader) || header->magic != WORLD_SAVE_MAGIC || 
+      header->version != WORLD_SAVE_VERSION || header->header_size != sizeof(WorldSaveHeader) ||
+      header->flags != WORLD_SAVE_LAYOUT_FLAGS ||
+      header->chunk_shift == 0 || header->chunk_shift > 8 ||
+      header->num_tile_chunks_x <= 0 || header->num_tile_chunks_x > 4096 ||
+      header->num_tile_chunks_y <= 0 || header->num_tile_chunks_y > 4096 ||
+      header->num_tile_chunks_z <= 0 || header->num_tile_chunks_z > 64 ||
+      !is_chunk_table_layout_valid(header->num_tile_chunks_x, header->num_tile_chunks_y) ||
+      !(header->tile_side_in_metres > 0.0f) ||
+      header->num_entities == 0 || header->num_entities > MAX_ENTITIES ||
+      header->player_entity_i >= header->num_entities)
+  {
+    return false;
+  }
+
+  u64 num_tile_chunks = (u64)header->num_tile_chunks_x * header->num_tile_chunks_y * 
+                        header->num_tile_chunks_z;
+  u64 chunk_tiles_size = ((u64)1 << (2 * header->chunk_shift)) * sizeof(u32);
+  if (num_tile_chunks > max_num_tile_chunks || header->num_chunks > num_tile_chunks ||
+      !is_file_range_valid(save->size, header->chunk_index_offset, 
+                           header->num_chunks * sizeof(WorldSaveChunk), 
+                           alignof(WorldSaveChunk)) ||
+      !is_file_range_valid(save->size, header->entities_offset, 
+                           header->num_entities * sizeof(WorldSaveEntity), 
+                           alignof(WorldSaveEntity)))
+  {
+    return false;
+  }
+
+  // NOTE(Ryan): Only the index is read here. Tile pages are left for first use to fault in
+  WorldSaveChunk *saved_chunks = (WorldSaveChunk *)(base + header->chunk_index_offset);
+  for (u32 saved_chunk_i = 0; saved_chunk_i < header->num_chunks; ++saved_chunk_i)
+  {
+    WorldSaveChunk *saved_chunk = &saved_chunks[saved_chunk_i];
+    if (saved_chunk->chunk_i >= num_tile_chunks ||
+        !is_file_range_valid(save->size, saved_chunk->tiles_offset, chunk_tiles_size, 
+                             alignof(u32)))
+    {
+      return false;
+    }
+  }
+
+  WorldSaveEntity *saved_entities = (WorldSaveEntity *)(base + header->entities_offset);
+  for (u32 entity_i = 0; entity_i < header->num_entities; ++entity_i)
+  {
+    u32 type = saved_entities[entity_i].type;
+    if (type != ENTITY_TYPE_PLAYER && type != ENTITY_TYPE_MONSTER) return false;
+    if ((type == ENTITY_TYPE_PLAYER) != (entity_i == header->player_entity_i)) return false;
+  }
+
+  return true;
+}
+
+// NOTE(Ryan): Chunks point straight into the mapping, which is never unmapped once loaded. 
+// Tile writes go to private copies of the pages, so the save on disk is untouched
+INTERNAL bool
+load_world(HHFThreadContext *thread, HHFPlatform *platform, State *state)
+{
+  HHFPlatformMappedFile save = platform->map_file(thread, WORLD_SAVE_FILE_NAME);
+  if (save.errno_code != 0) return false;
+
+  MemoryArena *world_arena = &state->world_arena;
+  u64 max_num_tile_chunks = (world_arena->size - world_arena->used) / sizeof(TileChunk);
+  if (!is_world_save_valid(&save, max_num_tile_chunks))
+  {
+    BP("World save rejected, generating a new world");
+    platform->unmap_file(thread, &save);
+    return false;
+  }
+
+  u8 *base = (u8 *)save.memory;
+  WorldSaveHeader *header = (WorldSaveHeader *)base;
+  TileMap *tile_map = state->world->tile_map;
+
+  tile_map->chunk_shift = header->chunk_shift;
+  tile_map->chunk_mask = (1U << tile_map->chunk_shift) - 1;
+  tile_map->chunk_dim = (1U << tile_map->chunk_shift);
+  tile_map->num_tile_chunks_x = header->num_tile_chunks_x;
+  tile_map->num_tile_chunks_y = header->num_tile_chunks_y;
+  tile_map->num_tile_chunks_z = header->num_tile_chunks_z;
+  tile_map->tile_side_in_metres = header->tile_side_in_metres;
+  tile_map->chunks = MEMORY_RESERVE_ARRAY(&state->world_arena, get_num_tile_chunks(tile_map), 
+                                          TileChunk);
+
+  WorldSaveChunk *saved_chunks = (WorldSaveChunk *)(base + header->chunk_index_offset);
+  for (u32 saved_chunk_i = 0; saved_chunk_i < header->num_chunks; ++saved_chunk_i)
+  {
+    WorldSaveChunk *saved_chunk = &saved_chunks[saved_chunk_i];
+    tile_map->chunks[saved_chunk->chunk_i].tiles = (u32 *)(base + saved_chunk->tiles_offset);
+  }
+
+  WorldSaveEntity *saved_entities = (WorldSaveEntity *)(base + header->entities_offset);
+  for (u32 entity_i = 0; entity_i < header->num_entities; ++entity_i)
+  {
+    WorldSaveEntity *saved_entity = &saved_entities[entity_i];
+    TileMapPosition pos = {};
+    pos.abs_tile_x = saved_entity->abs_tile_x;
+    pos.abs_tile_y = saved_entity->abs_tile_y;
+    pos.abs_tile_z = saved_entity->abs_tile_z;
+    pos.x_offset = saved_entity->x_offset;
+    pos.y_offset = saved_entity->y_offset;
+    EntityHandle entity = add_entity(state->entities, (ENTITY_TYPE)saved_entity->type, &pos,
+                                     saved_entity->half_dim);
+    state->entities->velocity[get_entity_index(state->entities, entity)] = 
+      saved_entity->velocity;
+    if (entity_i == header->player_entity_i) state->player = entity;
+  }
+
+  state->camera_pos.abs_tile_x = header->camera_abs_tile_x;
+  state->camera_pos.abs_tile_y = header->camera_abs_tile_y;
+  state->camera_pos.abs_tile_z = header->camera_abs_tile_z;
+  state->camera_pos.x_offset = header->camera_x_offset;
+  state->camera_pos.y_offset = header->camera_y_offset;
+  state->player_facing_direction = header->player_facing_direction & 3;
+
+  return true;
+}
+
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): The world saved into scratch must validate. Then one part of it, picked by 
+// check_i, is corrupted and it must not
+INTERNAL void
+debug_check_world_save(MemoryArena *arena, State *state, u32 check_i)
+{
+  TemporaryMemory temp_mem = begin_temporary_memory(arena);
+
+  TileMap *tile_map = state->world->tile_map;
+  u64 num_tile_chunks = get_num_tile_chunks(tile_map);
+  HHFPlatformMappedFile save = {};
+  save.memory = MEMORY_RESERVE_ARRAY(arena, get_world_save_size(state), u8);
+  save.size = save_world(state, (u8 *)save.memory);
+
+  if (!is_world_save_valid(&save, num_tile_chunks))
+  {
+    BP("Intact world save rejected");
+  }
+
+  u8 *base = (u8 *)save.memory;
+  WorldSaveHeader *header = (WorldSaveHeader *)base;
+  WorldSaveChunk *saved_chunks = (WorldSaveChunk *)(base + header->chunk_index_offset);
+  WorldSaveEntity *saved_entities = (WorldSaveEntity *)(base + header->entities_offset);
+  u64 chunk_tiles_size = (u64)tile_map->chunk_dim * tile_map->chunk_dim * sizeof(u32);
+  ASSERT(header->num_chunks > 0);
+
+  u32 hash = check_i * 2654435761u;
+  switch (check_i % 10)
+  {
+    // NOTE(Ryan): Chunk tiles come last, so any truncation cuts into the last chunk's
+    case 0: save.size = hash % save.size; break;
+    case 1: header->magic ^= 1U << (hash % 32); break;
+    case 2: header->version += 1 + (hash % 4); break;
+    case 3: header->chunk_index_offset = (hash & 1) ? save.size + 8 : ~(u64)0 - 7; break;
+    case 4: header->entities_offset = save.size - 4 * (hash % 8); break;
+    case 5: 
+    {
+      saved_chunks[hash % header->num_chunks].tiles_offset = \
+        save.size - chunk_tiles_size + 4 * (1 + (hash >> 8) % 16);
+    } break;
+    case 6: saved_chunks[hash % header->num_chunks].chunk_i = num_tile_chunks; break;
+    case 7: header->num_entities = MAX_ENTITIES + 1 + (hash % 16); break;
+    case 8: header->player_entity_i = header->num_entities; break;
+    case 9: 
+    {
+      u32 entity_i = hash % header->num_entities;
+      saved_entities[entity_i].type = (entity_i == header->player_entity_i) ? 
+                                      ENTITY_TYPE_NULL : ENTITY_TYPE_PLAYER;
+    } break;
+  }
+
+  if (is_world_save_valid(&save, num_tile_chunks))
+  {
+    BP("Corrupt world save accepted");
+  }
+
+  end_temporary_memory(temp_mem);
+}
+#endif
+
+INTERNAL void
+generate_world(State *state)
+{
+  TileMap *tile_map = state->world->tile_map;
+
+  state->camera_pos.abs_tile_x = 17 / 2;
+  state->camera_pos.abs_tile_y = 9 / 2; 
+
+  tile_map->chunk_shift = 4;
+  tile_map->chunk_mask = (1U << tile_map->chunk_shift) - 1;
+  tile_map->chunk_dim = (1U << tile_map->chunk_shift);
+  tile_map->num_tile_chunks_x = 128;
+  tile_map->num_tile_chunks_y = 128;
+  tile_map->num_tile_chunks_z = 2;
+  tile_map->tile_side_in_metres = 1.4f;
+  ASSERT(is_chunk_table_layout_valid(tile_map->num_tile_chunks_x, tile_map->num_tile_chunks_y));
+  // NOTE(Ryan): For basic sparseness we allocate chunk contents when we write to them
+  int tile_map_num_chunks = tile_map->num_tile_chunks_x * tile_map->num_tile_chunks_y *
+                            tile_map->num_tile_chunks_z;
+  tile_map->chunks = MEMORY_RESERVE_ARRAY(&state->world_arena, tile_map_num_chunks, TileChunk);
+
+  TileMapPosition player_pos = {};
+  player_pos.abs_tile_x = 1;
+  player_pos.abs_tile_y = 3;
+  player_pos.x_offset = 5.0f;
+  player_pos.y_offset = 5.0f;
+  recanonicalise_position(tile_map, &player_pos);
+  r32 player_width = 0.75f * tile_map->tile_side_in_metres;
+  // NOTE(Ryan): Collision box is the player's footprint around the ground point
+  state->player = add_entity(state->entities, ENTITY_TYPE_PLAYER, &player_pos,
+                             v2(0.5f * player_width, 0.25f * player_width));
+
+  srand(time(NULL));
+  int num_tiles_screen_x = 17;
+  int num_tiles_screen_y = 9;
+  int screen_x = 0;
+  int screen_y = 0;
+  int abs_tile_z = 0;
+  bool want_door = false;
+  bool have_drawn_door = false;
+  int random_index = 0;
+
+  for (int screen_i = 0; screen_i < 100; screen_i++)
+  {
+    // NOTE(Ryan): Think of mod as choice range
+    if (have_drawn_door) random_index = rand() % 2;
+    else random_index = rand() % 3;
+
+    if (random_index == 2) want_door = true;
+
+    for (int tile_y = 0; tile_y < num_tiles_screen_y; ++tile_y)
+    {
+      for (int tile_x = 0; tile_x < num_tiles_screen_x; ++tile_x)
+      {
+        int abs_tile_x = screen_x * num_tiles_screen_x + tile_x;
+        int abs_tile_y = screen_y * num_tiles_screen_y + tile_y;
+
+        u32 tile_value = 1;
+        if (tile_x == 0 || tile_x == num_tiles_screen_x - 1) 
+        {
+          // NOTE(Ryan): Although de morgan's laws could be used to reduce the number of
+          // boolean expressions, often best to make clear linguistically
+          if (tile_y != num_tiles_screen_y / 2) tile_value = 2;
+        }
+        if (tile_y == 0 || tile_y == num_tiles_screen_y - 1) 
+        {
+          if (tile_x != num_tiles_screen_x / 2) tile_value = 2;
+        }
+        // TODO(Ryan): The matching door is drawn in the next room along, which is a screen 
+        // away, so a door can lead onto a floor with no room above or below it
+        if (tile_x == 6 && tile_y == 3)
+        {
+          if (want_door)
           {
-            if (tile_x != num_tiles_screen_x / 2) tile_value = 2;
+            if (abs_tile_z == 0) tile_value = 3;
+            else tile_value = 4;
           }
-          if (tile_x == 6 && tile_y == 3)
+          if (have_drawn_door)
           {
-            if (want_door)
-            {
-              if (abs_tile_z == 0) tile_value = 3;
-              else tile_value = 4;
-            }
-            if (have_drawn_door)
-            {
-              if (abs_tile_z == 1) tile_value = 4;
-              else tile_value = 3;
-            }
+            if (abs_tile_z == 1) tile_value = 4;
+            else tile_value = 3;
           }
-
-          set_tile_value(&state->world_arena, world->tile_map, abs_tile_x, abs_tile_y,
-                         abs_tile_z, tile_value);
         }
-      }
 
-      if (random_index == 1)
-      {
-        screen_x += 1;
-      }
-      if (random_index == 2)
-      {
-        screen_y += 1;
+        set_tile_value(&state->world_arena, tile_map, abs_tile_x, abs_tile_y,
+                       abs_tile_z, tile_value);
       }
-      if (have_drawn_door)
-      {
-        have_drawn_door = false;
+    }
 
-        if (abs_tile_z == 0) abs_tile_z = 1;
-        else abs_tile_z = 0;
-      }
-      if (want_door)
-      {
-        want_door = false;
-        have_drawn_door = true;
+    for (int monster_i = 0; monster_i < 6; ++monster_i)
+    {
+      // NOTE(Ryan): Interior tiles, skipping the door
+      TileMapPosition monster_pos = {};
+      monster_pos.abs_tile_x = screen_x * num_tiles_screen_x + 1 + 
+                               (rand() % (num_tiles_screen_x - 2));
+      monster_pos.abs_tile_y = screen_y * num_tiles_screen_y + 1 + 
+                               (rand() % (num_tiles_screen_y - 2));
+      monster_pos.abs_tile_z = abs_tile_z;
+      if (monster_pos.abs_tile_x % num_tiles_screen_x == 6 && 
+          monster_pos.abs_tile_y % num_tiles_screen_y == 3) continue;
+
+      r32 monster_side = 0.5f * tile_map->tile_side_in_metres;
+      EntityHandle monster = add_entity(state->entities, ENTITY_TYPE_MONSTER, &monster_pos, 
+                                        v2(0.5f * monster_side, 0.25f * monster_side));
+      r32 monster_angle = (rand() % 360) * ((r32)M_PI / 180.0f);
+      state->entities->velocity[get_entity_index(state->entities, monster)] = 
+        1.5f * v2(cosf(monster_angle), sinf(monster_angle));
+    }
 
-        if (abs_tile_z == 0) abs_tile_z = 1;
-        else abs_tile_z = 0;
-      }
+    if (random_index == 1)
+    {
+      screen_x += 1;
+    }
+    if (random_index == 2)
+    {
+      screen_y += 1;
+    }
+    if (have_drawn_door)
+    {
+      have_drawn_door = false;
+
+      if (abs_tile_z == 0) abs_tile_z = 1;
+      else abs_tile_z = 0;
+    }
+    if (want_door)
+    {
+      want_door = false;
+      have_drawn_door = true;
+
+      if (abs_tile_z == 0) abs_tile_z = 1;
+      else abs_tile_z = 0;
     }
-    
+  }
+}
+
+extern "C" void
+hhf_update_and_render(HHFThreadContext *thread_context, HHFBackBuffer *back_buffer, 
+                      HHFSoundBuffer *sound_buffer, HHFInput *input, HHFMemory *memory, 
+                      HHFPlatform *platform)
+{
+  //BP(NULL);
+#if defined(HHF_INTERNAL)
+  debug_global_memory = memory;
+#endif
+  BEGIN_TIMED_BLOCK(UPDATE_AND_RENDER);
+
+  State *state = (State *)memory->permanent;
+  if (!memory->is_initialized)
+  {
+    // NOTE(Ryan): Asset derived data, e.g. bitmap span tables, is kept apart from the world
+    initialise_memory_arena(&state->asset_arena, MEGABYTES(8), 
+                            (u8 *)memory->permanent + sizeof(State));
+    initialise_memory_arena(&state->world_arena, 
+                            memory->permanent_size - sizeof(State) - state->asset_arena.size,
+                            (u8 *)memory->permanent + sizeof(State) + state->asset_arena.size);
+
+    load_assets(thread_context, platform, state);
+    state->loaded_asset_generation = memory->asset_generation;
+
+    state->world = MEMORY_RESERVE_STRUCT(&state->world_arena, World);
+    state->world->tile_map = MEMORY_RESERVE_STRUCT(&state->world_arena, TileMap);
+    state->entities = MEMORY_RESERVE_STRUCT(&state->world_arena, EntityStore);
+
+    if (!load_world(thread_context, platform, state)) generate_world(state);
+
     memory->is_initialized = true;
   }
 
+  // NOTE(Ryan): Platform bumps the generation when an asset file changes on disk
+  if (state->loaded_asset_generation != memory->asset_generation)
+  {
+    load_assets(thread_context, platform, state);
+    state->loaded_asset_generation = memory->asset_generation;
+  }
+
   World *world = state->world;
   TileMap *tile_map = world->tile_map;
 
@@ -703,171 +4632,361 @@ hhf_update_and_render(HHFThreadContext *thread_context, HHFBackBuffer *back_buff
   r32 player_width = 0.75f * tile_map->tile_side_in_metres;
   r32 player_height = tile_map->tile_side_in_metres;
 
-  // counting how many half transition counts over say half a second gives us
-  // whether the user 'dashed'
+#if defined(HHF_INTERNAL)
+  bool want_sprite_stress = false;
+  bool want_sprite_quad_stress = false;
+  bool want_blend_benchmark = false;
+#endif
+
+#if defined(HHF_INTERNAL)
   for (int controller_i = 0; controller_i < HHF_INPUT_MAX_NUM_CONTROLLERS; ++controller_i)
   {
-    // printf("mouse x: %d, mouse y: %d, mouse z: %d\n", input->mouse_x, input->mouse_y, input->mouse_z);
-    HHFInputController controller = input->controllers[controller_i];
-    if (controller.is_connected)
+    HHFInputController *controller = &input->controllers[controller_i];
+    if (controller->is_connected && !controller->is_analog)
     {
-      // analog override
-      if (controller.is_analog)
-      {
-      }
-      else
-      {
-        // digital tuning
-        r32 dplayer_x = 0.0f; 
-        r32 dplayer_y = 0.0f; 
+      if (controller->left_shoulder.ended_down) want_sprite_stress = true;
+      if (controller->right_shoulder.ended_down) want_sprite_quad_stress = true;
+      if (controller->back.ended_down) want_blend_benchmark = true;
+    }
+  }
+#endif
 
-        if (controller.action_right.ended_down) 
-        {
-          state->player_facing_direction = 0;
-          dplayer_x = 1.0f;
-        }
-        if (controller.action_up.ended_down) 
-        {
-          state->player_facing_direction = 1;
-          dplayer_y = 1.0f; 
-        }
-        if (controller.action_left.ended_down) 
+  TransientState *tran_state = (TransientState *)memory->transient;
+  if (!tran_state->is_initialised)
+  {
+    initialise_memory_arena(&tran_state->arena, memory->transient_size - sizeof(TransientState),
+                            (u8 *)memory->transient + sizeof(TransientState));
+    u32 num_tile_chunks = get_num_tile_chunks(tile_map);
+    tran_state->tile_draw_lists = MEMORY_RESERVE_ARRAY(&tran_state->arena, num_tile_chunks, 
+                                                       TileDrawList);
+    memset(tran_state->tile_draw_lists, 0, num_tile_chunks * sizeof(TileDrawList));
+
+    // NOTE(Ryan): Pages are only committed once a save touches them, so the worst case costs 
+    // nothing until the world grows into it
+    tran_state->save_buffer_size = get_max_world_save_size(tile_map);
+    tran_state->save_buffer = MEMORY_RESERVE_ARRAY(&tran_state->arena, 
+                                                   tran_state->save_buffer_size, u8);
+
+    // NOTE(Ryan): At the largest back buffer size, so a resize only changes the dimensions
+    u64 max_back_buffer_pixels = (u64)HHF_BACK_BUFFER_MAX_WIDTH * HHF_BACK_BUFFER_MAX_HEIGHT;
+    tran_state->tile_layer.memory = (u8 *)MEMORY_RESERVE_ARRAY(&tran_state->arena, 
+                                                               max_back_buffer_pixels, u32);
+#if defined(HHF_INTERNAL)
+    for (int buffer_i = 0; buffer_i < 2; ++buffer_i)
+    {
+      tran_state->debug_check_buffers[buffer_i].memory = \
+        (u8 *)MEMORY_RESERVE_ARRAY(&tran_state->arena, max_back_buffer_pixels, u32);
+    }
+#endif
+    tran_state->is_initialised = true;
+  }
+
+  // NOTE(Ryan): Simulation only ever advances in fixed steps, however many the platform 
+  // accumulated this frame. Rendering then interpolates between the last two steps
+  for (int sim_tick_i = 0; sim_tick_i < input->num_sim_ticks; ++sim_tick_i)
+  {
+    TileMapPosition player_pos = get_entity_pos(state->entities, 
+                                                get_entity_index(state->entities, state->player));
+    update_flow_field(&tran_state->arena, &tran_state->flow_field, tile_map, &player_pos, 1);
+
+    // NOTE(Ryan): A room either side of the camera's, which always holds the player
+    V2 sim_half_extent = tile_map->tile_side_in_metres * v2(17.0f, 9.0f);
+    TemporaryMemory sim_memory = begin_temporary_memory(&tran_state->arena);
+    SimRegion *sim_region = begin_sim(&tran_state->arena, state->entities, tile_map, 
+                                      &state->camera_pos, sim_half_extent);
+
+    u32 player_sim_i = find_sim_entity(sim_region, 
+                                       get_entity_index(state->entities, state->player));
+    ASSERT(player_sim_i != SIM_ENTITY_NONE);
+
+    // counting how many half transition counts over say half a second gives us
+    // whether the user 'dashed'
+    V2 player_velocity = {};
+    for (int controller_i = 0; controller_i < HHF_INPUT_MAX_NUM_CONTROLLERS; ++controller_i)
+    {
+      HHFInputController *controller = &input->controllers[controller_i];
+      if (controller->is_connected)
+      {
+        // analog override
+        if (controller->is_analog)
         {
-          state->player_facing_direction = 2;
-          dplayer_x = -1.0f;
         }
-        if (controller.action_down.ended_down) 
+        else
         {
-          state->player_facing_direction = 3;
-          dplayer_y = -1.0f;
+          player_velocity += get_player_velocity(state, controller);
         }
+      }
+    }
+    sim_region->velocity[player_sim_i] = player_velocity;
 
-        r32 player_speed = 2.0f;
-
-        if (controller.move_down.ended_down) player_speed = 10.0f;
+    simulate_entities(&tran_state->arena, sim_region, tile_map, &tran_state->flow_field, 
+                      input->sim_dt);
 
-        dplayer_x *= player_speed;
-        dplayer_y *= player_speed;
+    end_sim(&tran_state->arena, sim_region, state->entities, tile_map);
+    end_temporary_memory(sim_memory);
 
-        TileMapPosition test_player_pos = state->player_pos;
-        test_player_pos.x_offset += (dplayer_x * input->frame_dt);
-        test_player_pos.y_offset += (dplayer_y * input->frame_dt); 
-        recanonicalise_position(tile_map, &test_player_pos);
+    update_camera(state, tile_map);
+  }
 
-        TileMapPosition player_left_pos = test_player_pos;
-        player_left_pos.x_offset -= (0.5f * player_width);
-        recanonicalise_position(tile_map, &player_left_pos);
+  bool want_save = false;
+  for (int controller_i = 0; controller_i < HHF_INPUT_MAX_NUM_CONTROLLERS; ++controller_i)
+  {
+    HHFInputController *controller = &input->controllers[controller_i];
+    if (controller->is_connected && controller->start.ended_down && 
+        controller->start.half_transition_count > 0)
+    {
+      want_save = true;
+    }
+  }
 
-        TileMapPosition player_right_pos = test_player_pos;
-        player_right_pos.x_offset += (0.5f * player_width);
-        recanonicalise_position(tile_map, &player_right_pos);
+  if (tran_state->is_saving)
+  {
+    HHF_IO_STATUS save_status = platform->poll_io(thread_context, &tran_state->save_request);
+    if (save_status != HHF_IO_STATUS_PENDING) tran_state->is_saving = false;
+    if (save_status == HHF_IO_STATUS_FAILED) 
+    {
+      BP("World save failed");
+    }
+  }
+  // NOTE(Ryan): Snapshot at the end of this frame's simulation. Presses whilst a save is 
+  // still being written are ignored
+  if (want_save && !tran_state->is_saving)
+  {
+    ASSERT(get_world_save_size(state) <= tran_state->save_buffer_size);
+    u64 save_size = save_world(state, tran_state->save_buffer);
+    tran_state->save_request = platform->write_entire_file(thread_context, WORLD_SAVE_FILE_NAME,
+                                                           tran_state->save_buffer, save_size);
+    tran_state->is_saving = (tran_state->save_request.errno_code == 0);
+    if (!tran_state->is_saving) 
+    {
+      BP("World save failed");
+    }
+  }
 
-        // TODO(Ryan): Fix stopping before walls and possibly going through thin walls
-        bool tile_is_valid = is_tile_map_point_empty(tile_map, &test_player_pos) &&
-          is_tile_map_point_empty(tile_map, &player_left_pos) && 
-          is_tile_map_point_empty(tile_map, &player_right_pos);
+#if defined(HHF_INTERNAL)
+  // NOTE(Ryan): Before the backdrop, which then covers what it wrote
+  if (want_blend_benchmark) debug_benchmark_blends(back_buffer, &state->player_bitmaps[0].torso);
+  if (memory->debug_want_benchmarks)
+  {
+    debug_run_benchmarks(tran_state, memory, tile_map);
+    memory->debug_want_benchmarks = false;
+  }
+  if (memory->debug_checks_are_enabled) 
+  {
+    debug_run_render_checks(tran_state, state, back_buffer, tile_side_in_pixels);
+    debug_check_world_save(&tran_state->arena, state, tran_state->debug_check_i);
+  }
+#endif
 
-        if (tile_is_valid) 
-        {
-          if (!are_on_same_tile(&state->player_pos, &test_player_pos))
-          {
-            u32 new_tile_value = get_tile_value(tile_map, &test_player_pos);
-            if (new_tile_value == 3)
-            {
-              test_player_pos.abs_tile_z += 1;
-            }
-            if (new_tile_value == 4)
-            {
-              test_player_pos.abs_tile_z -= 1;
-            }
-          }
+  HHFBackBuffer *tile_layer = &tran_state->tile_layer;
+  if (tile_layer->width != back_buffer->width || tile_layer->height != back_buffer->height)
+  {
+    ASSERT(back_buffer->width <= HHF_BACK_BUFFER_MAX_WIDTH && 
+           back_buffer->height <= HHF_BACK_BUFFER_MAX_HEIGHT);
+    tile_layer->width = back_buffer->width;
+    tile_layer->height = back_buffer->height;
+    tran_state->tile_layer_is_valid = false;
+  }
 
-          state->player_pos = test_player_pos;
-        }
+  bool want_full_redraw = back_buffer->needs_full_redraw;
+#if defined(HHF_INTERNAL)
+  // NOTE(Ryan): Writes straight into the back buffer, bypassing dirty tracking
+  if (want_blend_benchmark) want_full_redraw = true;
+#endif
 
-        state->camera_pos.abs_tile_z = state->player_pos.abs_tile_z;
+  if (!tran_state->tile_layer_is_valid || 
+      !are_same_position(&tran_state->tile_layer_camera_pos, &state->camera_pos) ||
+      tran_state->tile_layer_tile_generation != tile_map->tile_generation ||
+      tran_state->tile_layer_asset_generation != state->loaded_asset_generation)
+  {
+    render_tile_layer(tile_layer, &tran_state->arena, tran_state->tile_draw_lists, tile_map, 
+                      &state->backdrop, &state->camera_pos, tile_side_in_pixels);
+
+    tran_state->tile_layer_camera_pos = state->camera_pos;
+    tran_state->tile_layer_tile_generation = tile_map->tile_generation;
+    tran_state->tile_layer_asset_generation = state->loaded_asset_generation;
+    tran_state->tile_layer_is_valid = true;
+    want_full_redraw = true;
+  }
 
-        TileMapDifference diff = subtract(tile_map, &state->player_pos, &state->camera_pos);
+  // NOTE(Ryan): Only last frame's dynamic areas differ from the tile layer, so restoring those
+  // is enough. What is drawn on top then marks its own areas dirty 
+  BEGIN_TIMED_BLOCK(BLIT_TILE_LAYER);
+  int num_pixels_restored = 0;
+  back_buffer->num_dirty_rects = 0;
+  if (want_full_redraw)
+  {
+    HHFRect full_rect = {0, 0, back_buffer->width, back_buffer->height};
+    copy_rect(back_buffer, tile_layer, &full_rect);
+    add_dirty_rect(back_buffer, 0, 0, back_buffer->width, back_buffer->height);
+    num_pixels_restored = back_buffer->width * back_buffer->height;
+    back_buffer->needs_full_redraw = false;
+  }
+  else
+  {
+    for (int rect_i = 0; rect_i < tran_state->num_prev_dynamic_rects; ++rect_i)
+    {
+      HHFRect *rect = &tran_state->prev_dynamic_rects[rect_i];
+      copy_rect(back_buffer, tile_layer, rect);
+      add_dirty_rect(back_buffer, rect->min_x, rect->min_y, rect->max_x, rect->max_y);
+      num_pixels_restored += (rect->max_x - rect->min_x) * (rect->max_y - rect->min_y);
+    }
+  }
+  int first_dynamic_rect_i = back_buffer->num_dirty_rects;
+  END_TIMED_BLOCK_COUNTED(BLIT_TILE_LAYER, num_pixels_restored);
+
+#if defined(HHF_INTERNAL)
+  // NOTE(Ryan): Drawing on top then gives the same frame as a full redraw only if restoring 
+  // last frame's dynamic rects left the whole back buffer equal to the tile layer
+  if (memory->debug_checks_are_enabled &&
+      memcmp(back_buffer->memory, tile_layer->memory, 
+             (u64)back_buffer->width * back_buffer->height * sizeof(u32)) != 0)
+  {
+    BP("Restored back buffer differs from tile layer");
+  }
+#endif
 
-        // NOTE(Ryan): Screens are 17 / 9, so half screen widths
-        if (diff.dx > (9.0f * tile_map->tile_side_in_metres))
-        {
-          state->camera_pos.abs_tile_x += 17;
-        }
-        if (diff.dx < -(9.0f * tile_map->tile_side_in_metres))
-        {
-          state->camera_pos.abs_tile_x -= 17;
-        }
-        if (diff.dy > (5.0f * tile_map->tile_side_in_metres))
-        {
-          state->camera_pos.abs_tile_y += 9;
-        }
-        if (diff.dy < -(5.0f * tile_map->tile_side_in_metres))
-        {
-          state->camera_pos.abs_tile_y -= 9;
-        }
+  EntityStore *entities = state->entities;
+  u32 player_i = get_entity_index(entities, state->player);
+  r32 player_ground_point_x = 0.0f;
+  r32 player_ground_point_y = 0.0f;
+  for (u32 entity_i = 0; entity_i < entities->count; ++entity_i)
+  {
+    if (entities->abs_tile_z[entity_i] != state->camera_pos.abs_tile_z) continue;
 
-      }
+    // NOTE(Ryan): Lerp from the previous tick's position, except across a floor change 
+    TileMapPosition entity_pos = get_entity_pos(entities, entity_i);
+    TileMapDifference diff = subtract(tile_map, &entity_pos, &state->camera_pos);
+    if (fabsf(diff.dx) > screen_centre_x / metres_to_pixels + tile_map->tile_side_in_metres ||
+        fabsf(diff.dy) > screen_centre_y / metres_to_pixels + tile_map->tile_side_in_metres)
+    {
+      continue;
+    }
+    if (entities->prev_pos[entity_i].abs_tile_z == entity_pos.abs_tile_z)
+    {
+      TileMapDifference prev_diff = subtract(tile_map, &entities->prev_pos[entity_i], 
+                                             &state->camera_pos);
+      diff.dx = prev_diff.dx + input->render_alpha * (diff.dx - prev_diff.dx);
+      diff.dy = prev_diff.dy + input->render_alpha * (diff.dy - prev_diff.dy);
+    }
+    // the screen centre is always where the camera is
+    r32 ground_point_x = screen_centre_x + (metres_to_pixels * diff.dx); 
+    r32 ground_point_y = screen_centre_y - (metres_to_pixels * diff.dy);
 
+    if (entity_i == player_i)
+    {
+      player_ground_point_x = ground_point_x;
+      player_ground_point_y = ground_point_y;
+
+      r32 player_min_x = ground_point_x - (player_width * metres_to_pixels * 0.5f);
+      r32 player_min_y = ground_point_y - (player_height * metres_to_pixels);
+      draw_rect(back_buffer, player_min_x, player_min_y, 
+                player_min_x + player_width*metres_to_pixels, 
+                player_min_y + player_height*metres_to_pixels, player_r, player_g, player_b);
+    }
+    else
+    {
+      r32 monster_width = 2.0f * entities->half_dim[entity_i].x * metres_to_pixels;
+      r32 monster_min_x = ground_point_x - 0.5f * monster_width;
+      r32 monster_min_y = ground_point_y - monster_width;
+      draw_rect(back_buffer, monster_min_x, monster_min_y, monster_min_x + monster_width, 
+                ground_point_y, 1.0f, 0.3f, 0.2f);
     }
   }
+  
+  // NOTE(Ryan): Ground point is not rounded, so the hero moves smoothly
+  PlayerBitmap *active_player_bitmap = &state->player_bitmaps[state->player_facing_direction];
+  draw_bmp_subpixel(back_buffer, &active_player_bitmap->legs, player_ground_point_x, 
+                    player_ground_point_y, active_player_bitmap->align_x, 
+                    active_player_bitmap->align_y); 
+  draw_bmp_subpixel(back_buffer, &active_player_bitmap->torso, player_ground_point_x, 
+                    player_ground_point_y, active_player_bitmap->align_x, 
+                    active_player_bitmap->align_y); 
+  draw_bmp_subpixel(back_buffer, &active_player_bitmap->head, player_ground_point_x, 
+                    player_ground_point_y, active_player_bitmap->align_x, 
+                    active_player_bitmap->align_y); 
+
+#if defined(HHF_INTERNAL)
+  // NOTE(Ryan): Sprite heavy scene to compare DRAW_BMP cycles per pixel
+  if (want_sprite_stress)
+  {
+    debug_benchmark_draw_bmp(&tran_state->arena, back_buffer, state->player_bitmaps);
 
-  draw_bmp(back_buffer, &state->backdrop, 0.0f, 0.0f); 
-
-  // draw_rect(back_buffer, 0, 0, back_buffer->width, back_buffer->height, 1.0f, 0.0f, 1.0f);
+    for (int stress_y = 0; stress_y < 4; ++stress_y)
+    {
+      for (int stress_x = 0; stress_x < 16; ++stress_x)
+      {
+        PlayerBitmap *stress_bitmap = &state->player_bitmaps[(stress_x + stress_y) % 4];
+        r32 stress_ground_x = 30.0f + stress_x * 60.0f;
+        r32 stress_ground_y = 180.0f + stress_y * 120.0f;
+        draw_bmp(back_buffer, &stress_bitmap->legs, stress_ground_x, stress_ground_y,
+                 stress_bitmap->align_x, stress_bitmap->align_y); 
+        draw_bmp(back_buffer, &stress_bitmap->torso, stress_ground_x, stress_ground_y,
+                 stress_bitmap->align_x, stress_bitmap->align_y); 
+        draw_bmp(back_buffer, &stress_bitmap->head, stress_ground_x, stress_ground_y,
+                 stress_bitmap->align_x, stress_bitmap->align_y); 
+      }
+    }
+  }
 
-  for (int rel_y = -10; rel_y < 10; ++rel_y)
+  // NOTE(Ryan): Same scene rotating and scaling, to check DRAW_BMP_QUAD keeps a screen in budget
+  if (want_sprite_quad_stress)
   {
-    for (int rel_x = -20; rel_x < 20; ++rel_x)
+    state->debug_sprite_stress_t += input->num_sim_ticks * input->sim_dt;
+    r32 stress_angle = state->debug_sprite_stress_t;
+    r32 stress_scale = 0.75f + 0.25f * sinf(2.0f * state->debug_sprite_stress_t);
+    V2 stress_x_axis = v2(cosf(stress_angle), sinf(stress_angle));
+    V2 stress_y_axis = perp(stress_x_axis);
+    for (int stress_y = 0; stress_y < 4; ++stress_y)
     {
-      u32 y = state->camera_pos.abs_tile_y + rel_y;
-      u32 x = state->camera_pos.abs_tile_x + rel_x;
-      u32 z = state->camera_pos.abs_tile_z;
-      u32 tile_id = get_tile_value(tile_map, x, y, z);
-      // TODO(Ryan): 0 is not defined, 1 is walkable, 2 is wall
-      if (tile_id > 1)
+      for (int stress_x = 0; stress_x < 16; ++stress_x)
       {
-        r32 whitescale = 0.5f;
-        if (tile_id == 2) whitescale = 1.0f;
-        if (tile_id == 3 || tile_id == 4) whitescale = 0.25f;
-
-        if (x == state->camera_pos.abs_tile_x && 
-              y == state->camera_pos.abs_tile_y) whitescale = 0.0f;
-
-        // IMPORTANT(Ryan): Smooth scrolling acheived by drawing the map around the player,
-        // whilst keeping the player in the centre of the screen.
-        // Therefore, incorporate the player offset in the tile drawing
-        r32 centre_x = screen_centre_x - (metres_to_pixels*state->camera_pos.x_offset) +
-                        ((r32)rel_x * tile_side_in_pixels);
-        r32 centre_y = screen_centre_y + (metres_to_pixels*state->camera_pos.y_offset) -
-                        ((r32)rel_y * tile_side_in_pixels);
-        r32 min_x = centre_x - 0.5f * tile_side_in_pixels; 
-        r32 min_y = centre_y - 0.5f * tile_side_in_pixels; 
-        r32 max_x = centre_x + 0.5f * tile_side_in_pixels;
-        r32 max_y = centre_y + 0.5f * tile_side_in_pixels;
-
-        draw_rect(back_buffer, min_x, min_y, max_x, max_y, whitescale, whitescale, whitescale);
+        PlayerBitmap *stress_bitmap = &state->player_bitmaps[(stress_x + stress_y) % 4];
+        V2 stress_centre = v2(30.0f + stress_x * 60.0f, 70.0f + stress_y * 135.0f);
+        LoadedBitmap *stress_layers[3] = {&stress_bitmap->legs, &stress_bitmap->torso, 
+                                          &stress_bitmap->head};
+        for (int layer_i = 0; layer_i < 3; ++layer_i)
+        {
+          LoadedBitmap *layer = stress_layers[layer_i];
+          V2 x_axis = (stress_scale * layer->width) * stress_x_axis;
+          V2 y_axis = (stress_scale * layer->height) * stress_y_axis;
+          V2 origin = stress_centre - 0.5f * x_axis - 0.5f * y_axis;
+          draw_bmp_quad(back_buffer, layer, origin, x_axis, y_axis);
+        }
       }
     }
   }
+#endif
 
-  TileMapDifference diff = subtract(state->world->tile_map, &state->player_pos, &state->camera_pos);
-  // the screen centre is always where the camera is
-  r32 player_ground_point_x = screen_centre_x + (metres_to_pixels * diff.dx); 
-  r32 player_ground_point_y = screen_centre_y - (metres_to_pixels * diff.dy);
+#if defined(HHF_INTERNAL)
+  if (memory->debug_overlay_is_visible)
+  {
+    draw_debug_overlay(back_buffer, &tran_state->text_batch, &state->debug_font, memory, 
+                       state, tran_state, sound_buffer->samples_per_second);
+  }
+  else
+  {
+    char frame_stats[32] = {};
+    snprintf(frame_stats, sizeof(frame_stats), "%.02fms", memory->debug_ms_per_frame);
+    push_text(&tran_state->text_batch, &state->debug_font, 8, 8, frame_stats);
+  }
+#endif
+  flush_text_batch(back_buffer, &tran_state->text_batch, &state->debug_font);
 
-  r32 player_min_x = player_ground_point_x - (player_width * metres_to_pixels * 0.5f);
-  r32 player_min_y = player_ground_point_y - (player_height * metres_to_pixels);
-  draw_rect(back_buffer, player_min_x, player_min_y, 
-            player_min_x + player_width*metres_to_pixels, 
-            player_min_y + player_height*metres_to_pixels, player_r, player_g, player_b);
-  
-  PlayerBitmap *active_player_bitmap = &state->player_bitmaps[state->player_facing_direction];
-  draw_bmp(back_buffer, &active_player_bitmap->legs, player_ground_point_x, player_ground_point_y,
-           active_player_bitmap->align_x, active_player_bitmap->align_y); 
-  draw_bmp(back_buffer, &active_player_bitmap->torso, player_ground_point_x, player_ground_point_y,
-           active_player_bitmap->align_x, active_player_bitmap->align_y); 
-  draw_bmp(back_buffer, &active_player_bitmap->head, player_ground_point_x, player_ground_point_y,
-           active_player_bitmap->align_x, active_player_bitmap->align_y); 
+  // NOTE(Ryan): If the list overflowed, the last rect may also cover restored areas, 
+  // which is harmless as restoring them again is still correct
+  tran_state->num_prev_dynamic_rects = 0;
+  for (int rect_i = first_dynamic_rect_i; rect_i < back_buffer->num_dirty_rects; ++rect_i)
+  {
+    tran_state->prev_dynamic_rects[tran_state->num_prev_dynamic_rects++] = 
+      back_buffer->dirty_rects[rect_i];
+  }
+  if (first_dynamic_rect_i == back_buffer->num_dirty_rects && 
+      back_buffer->num_dirty_rects == HHF_BACK_BUFFER_MAX_DIRTY_RECTS)
+  {
+    tran_state->prev_dynamic_rects[tran_state->num_prev_dynamic_rects++] = 
+      back_buffer->dirty_rects[HHF_BACK_BUFFER_MAX_DIRTY_RECTS - 1];
+  }
 
+  END_TIMED_BLOCK(UPDATE_AND_RENDER);
 }
@@ -14,6 +14,9 @@
 #include <limits.h>
 #include <inttypes.h>
 
+#include "hhf-intrinsics.h"
+#include "hhf-math.h"
+
 #define BILLION 1000000000L
 
 #define CLEAR_ASCII_ESCAPE "\033[1;1H\033[2K"
@@ -35,22 +38,44 @@ INTERNAL void __ebp(char const *msg)
 // NOTE(Ryan): Could use this to catch out of bounds array 
 #define ASSERT(cond) if (!(cond)) {BP("ASSERT");}
 #else
-#define BP(msg)
-#define EBP(msg)
+// NOTE(Ryan): Expand to a statement, so 'if (x) BP(msg);' is not an empty body
+#define BP(msg) ((void)0)
+#define EBP(msg) ((void)0)
 #define ASSERT(cond)
 #endif
 
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): Set each frame as globals in the shared object are clobbered on reload
+GLOBAL HHFMemory *debug_global_memory;
+#define BEGIN_TIMED_BLOCK(id) \
+  u64 start_cycle_count_##id = read_cpu_timer();
+#define END_TIMED_BLOCK_COUNTED(id, count) \
+  debug_global_memory->debug_cycle_counters[DEBUG_CYCLE_COUNTER_##id].cycle_count += \
+    read_cpu_timer() - start_cycle_count_##id; \
+  debug_global_memory->debug_cycle_counters[DEBUG_CYCLE_COUNTER_##id].hit_count += (count);
+#define END_TIMED_BLOCK(id) END_TIMED_BLOCK_COUNTED(id, 1)
+#else
+#define BEGIN_TIMED_BLOCK(id)
+#define END_TIMED_BLOCK_COUNTED(id, count)
+#define END_TIMED_BLOCK(id)
+#endif
+
 #define ARRAY_LEN(arr) \
   (sizeof(arr)/sizeof(arr[0]))
 
+#define MIN(a, b) \
+  ((a) < (b) ? (a) : (b))
+#define MAX(a, b) \
+  ((a) > (b) ? (a) : (b))
+
 #define KILOBYTES(n) \
   ((n) * 1024UL)
 #define MEGABYTES(n) \
-  ((n) * KILOBYTES(n))
+  ((n) * KILOBYTES(1024))
 #define GIGABYTES(n) \
-  ((n) * MEGABYTES(n))
+  ((n) * MEGABYTES(1024))
 #define TERABYTES(n) \
-  ((n) * GIGABYTES(n))
+  ((n) * GIGABYTES(1024))
 
 inline u32
 safe_truncate_u64(u64 val)
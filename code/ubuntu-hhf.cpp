@@ -18,6 +18,11 @@
 #include <linux/input.h>
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -41,15 +46,46 @@ struct UdevPollDevice
 {
   UDEV_DEVICE_TYPE type;
   int hhf_i;
+  // NOTE(Ryan): Removal events only give the devnode, so it's how an fd is found again
+  char dev_path[64];
 };
-//struct UdevHotplugDevice
-//{
-//  char dev_path[64];
-//  int fd;
-//};
 #define MAX_PROCESS_FDS 1024
-#define EPOLL_UDEV_MAX_EVENTS 5
-#define MAX_UDEV_DEVICES 32
+#define EPOLL_UDEV_MAX_EVENTS 32
+
+// NOTE(Ryan): Beyond evdev's types, so hotplugging can be ordered with input from the device
+#define INPUT_EVENT_TYPE_CONNECTED (EV_MAX + 1)
+#define INPUT_EVENT_TYPE_DISCONNECTED (EV_MAX + 2)
+struct InputEvent
+{
+  u64 time_ns;
+  int hhf_i;
+  u16 type;
+  u16 code;
+  s32 value;
+};
+
+// NOTE(Ryan): Input thread is the only producer and the main thread the only consumer, 
+// so the indices just need acquire/release ordering. They are free running, wrapping on u32
+#define INPUT_EVENT_QUEUE_SIZE 4096
+struct InputEventQueue
+{
+  InputEvent events[INPUT_EVENT_QUEUE_SIZE];
+  alignas(64) u32 write_i;
+  alignas(64) u32 read_i;
+  u32 num_dropped;
+};
+
+// NOTE(Ryan): After startup, only the input thread touches these 
+struct InputThreadContext
+{
+  int epoll_fd;
+  UdevPollDevice *poll_devices;
+  InputEventQueue *queue;
+
+  struct udev_monitor *udev_monitor;
+  int udev_monitor_fd;
+  bool controller_slot_is_used[HHF_INPUT_MAX_NUM_CONTROLLERS];
+};
 
 // TODO(Ryan): Investigate using $(pasuspender -- ./build/ubuntu-hhf) to allow ALSA usage directly
 #include <pulse/simple.h>
@@ -65,13 +101,64 @@ struct XlibInfo
   Atom state, maxh, maxv, fullscreen;
 };
 
+INTERNAL u64
+get_monotonic_ns(void)
+{
+  struct timespec now = {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (BILLION * (u64)now.tv_sec) + (u64)now.tv_nsec;
+}
+
+INTERNAL void
+input_event_queue_push(InputEventQueue *queue, InputEvent *event)
+{
+  u32 write_i = queue->write_i;
+  u32 read_i = __atomic_load_n(&queue->read_i, __ATOMIC_ACQUIRE);
+  if (write_i - read_i == INPUT_EVENT_QUEUE_SIZE)
+  {
+    // NOTE(Ryan): Only if main thread stalls for thousands of events, e.g. in a debugger
+    queue->num_dropped++;
+  }
+  else
+  {
+    queue->events[write_i & (INPUT_EVENT_QUEUE_SIZE - 1)] = *event;
+    __atomic_store_n(&queue->write_i, write_i + 1, __ATOMIC_RELEASE);
+  }
+}
+
 INTERNAL void
-udev_possibly_add_device(int epoll_fd, struct udev_device *device, 
-                         UdevPollDevice poll_devices[MAX_PROCESS_FDS],
-                         HHFInput *input)
+input_event_queue_push_connection(InputEventQueue *queue, int hhf_i, bool is_connected, 
+                                  bool is_analog)
 {
-  LOCAL_PERSIST int hhf_i = 0;
+  InputEvent event = {};
+  event.time_ns = get_monotonic_ns();
+  event.hhf_i = hhf_i;
+  event.type = (is_connected ? INPUT_EVENT_TYPE_CONNECTED : INPUT_EVENT_TYPE_DISCONNECTED);
+  event.value = is_analog;
+  input_event_queue_push(queue, &event);
+}
+
+INTERNAL bool
+udev_is_device_tracked(InputThreadContext *context, char *dev_path)
+{
+  bool result = false;
+
+  for (int dev_fd = 0; dev_fd < MAX_PROCESS_FDS; ++dev_fd)
+  {
+    UdevPollDevice *dev = &context->poll_devices[dev_fd];
+    if (dev->type != UDEV_DEVICE_TYPE_IGNORE && strcmp(dev->dev_path, dev_path) == 0)
+    {
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
 
+INTERNAL void
+udev_possibly_add_device(InputThreadContext *context, struct udev_device *device)
+{
   UDEV_DEVICE_TYPE dev_type = UDEV_DEVICE_TYPE_IGNORE;
 
   char *dev_prop = (char *)udev_device_get_property_value(device, "ID_INPUT_KEYBOARD");
@@ -84,49 +171,123 @@ udev_possibly_add_device(int epoll_fd, struct udev_device *device,
   dev_prop = (char *)udev_device_get_property_value(device, "ID_INPUT_JOYSTICK");
   if (dev_prop != NULL && strcmp(dev_prop, "1") == 0) dev_type = UDEV_DEVICE_TYPE_GAMEPAD;
 
-  if (dev_type != UDEV_DEVICE_TYPE_IGNORE)
+  // NOTE(Ryan): The monitor is enabled before enumerating, so a device plugged in between is 
+  // reported by both. Opening it twice would take two controller slots
+  char *dev_path = (char *)udev_device_get_devnode(device);
+  if (dev_type != UDEV_DEVICE_TYPE_IGNORE && dev_path != NULL && 
+      !udev_is_device_tracked(context, dev_path))
   {
-    char *dev_path = (char *)udev_device_get_devnode(device);
-    if (dev_path != NULL)
+    // NOTE(Ryan): Mice all feed the one mouse state, so don't take a controller slot
+    int hhf_i = 0;
+    if (dev_type != UDEV_DEVICE_TYPE_MOUSE)
+    {
+      hhf_i = -1;
+      for (int slot_i = 0; slot_i < HHF_INPUT_MAX_NUM_CONTROLLERS; ++slot_i)
+      {
+        if (!context->controller_slot_is_used[slot_i])
+        {
+          hhf_i = slot_i;
+          break;
+        }
+      }
+    }
+
+    // TODO(Ryan): Devices beyond the controller slots are ignored until one is unplugged
+    if (hhf_i != -1)
     {
+      // NOTE(Ryan): Typically fails with EACCES when the user isn't in the 'input' group.
+      // Device is then ignored, so it doesn't hold a slot or report a connection
       int dev_fd = open(dev_path, O_RDWR | O_NONBLOCK);
-      if (dev_fd == -1) EBP(NULL);
+      if (dev_fd == -1) EBP(dev_path);
+      else if (dev_fd >= MAX_PROCESS_FDS)
+      {
+        BP("Device fd beyond poll devices");
+        close(dev_fd);
+      }
+      else
+      {
+        // NOTE(Ryan): Default is CLOCK_REALTIME, which can't be compared with frame times 
+        int dev_clock_id = CLOCK_MONOTONIC;
+        if (ioctl(dev_fd, EVIOCSCLOCKID, &dev_clock_id) == -1) EBP(NULL);
 
-      struct epoll_event event = {};
-      event.events = EPOLLIN;
-      event.data.fd = dev_fd;
-      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dev_fd, &event);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = dev_fd;
+        epoll_ctl(context->epoll_fd, EPOLL_CTL_ADD, dev_fd, &event);
 
-      if (dev_type != UDEV_DEVICE_TYPE_MOUSE)
-      {
-        UdevPollDevice *dev = &poll_devices[dev_fd];
+        UdevPollDevice *dev = &context->poll_devices[dev_fd];
         dev->type = dev_type;
+        dev->hhf_i = hhf_i;
+        strncpy(dev->dev_path, dev_path, sizeof(dev->dev_path) - 1);
 
-        ASSERT(hhf_i < HHF_INPUT_MAX_NUM_CONTROLLERS);
-        input->controllers[hhf_i].is_connected = true;
-        if (dev->type == UDEV_DEVICE_TYPE_GAMEPAD) 
+        if (dev_type != UDEV_DEVICE_TYPE_MOUSE)
         {
-          input->controllers[hhf_i].is_analog = true;
+          context->controller_slot_is_used[hhf_i] = true;
+          input_event_queue_push_connection(context->queue, hhf_i, true, 
+                                            dev_type == UDEV_DEVICE_TYPE_GAMEPAD);
         }
-        dev->hhf_i = hhf_i++;
       }
+    }
+  }
 
-      //strncpy(hotplug_devices[hotplug_device_cursor].dev_path, dev_path, 64);
-      // TODO(Ryan): Removing a device won't reset this so continuosly adding and
-      // removing a device will cause this to segfault
-      //hotplug_devices[hotplug_device_cursor++].fd = dev_fd;
+  udev_device_unref(device);
+}
+
+INTERNAL void
+udev_possibly_remove_device(InputThreadContext *context, struct udev_device *device)
+{
+  char *dev_path = (char *)udev_device_get_devnode(device);
+  if (dev_path != NULL)
+  {
+    for (int dev_fd = 0; dev_fd < MAX_PROCESS_FDS; ++dev_fd)
+    {
+      UdevPollDevice *dev = &context->poll_devices[dev_fd];
+      if (dev->type != UDEV_DEVICE_TYPE_IGNORE && strcmp(dev->dev_path, dev_path) == 0)
+      {
+        // NOTE(Ryan): Closing also removes it from the epoll set
+        close(dev_fd);
+
+        if (dev->type != UDEV_DEVICE_TYPE_MOUSE)
+        {
+          context->controller_slot_is_used[dev->hhf_i] = false;
+          input_event_queue_push_connection(context->queue, dev->hhf_i, false, false);
+        }
+
+        *dev = {};
+        break;
+      }
     }
   }
 
   udev_device_unref(device);
 }
 
+INTERNAL void
+udev_check_hotplug_devices(InputThreadContext *context)
+{
+  struct udev_device *device = udev_monitor_receive_device(context->udev_monitor);
+  if (device != NULL)
+  {
+    char *action = (char *)udev_device_get_action(device);
+    if (action != NULL && strcmp(action, "add") == 0)
+    {
+      udev_possibly_add_device(context, device);
+    }
+    else if (action != NULL && strcmp(action, "remove") == 0)
+    {
+      udev_possibly_remove_device(context, device);
+    }
+    else
+    {
+      udev_device_unref(device);
+    }
+  }
+}
+
 // TODO(Ryan): Replace with raw evdev. Limiting solely using udev as "input" is presumabley only HID
 // Udev only of use with hotplugging.
 INTERNAL void
-udev_populate_devices(struct udev *udev_obj, int epoll_fd, 
-                      UdevPollDevice poll_devices[MAX_PROCESS_FDS],
-                      HHFInput *hhf_input)
+udev_populate_devices(struct udev *udev_obj, InputThreadContext *context)
 {
   struct udev_enumerate *udev_enum = udev_enumerate_new(udev_obj);
   if (udev_enum == NULL) BP(NULL);
@@ -145,7 +306,7 @@ udev_populate_devices(struct udev *udev_obj, int epoll_fd,
     struct udev_device *device = udev_device_new_from_syspath(udev_obj, 
                                                               udev_entry_syspath);
 
-    udev_possibly_add_device(epoll_fd, device, poll_devices, hhf_input);
+    udev_possibly_add_device(context, device);
   }
 
   udev_enumerate_unref(udev_enum);
@@ -158,6 +319,81 @@ timespec_diff(struct timespec *start, struct timespec *end)
          (end->tv_nsec - start->tv_nsec);
 }
 
+// NOTE(Ryan): Scheduler can wake us late, so sleep short and spin the remainder 
+#define SLEEP_SPIN_TAIL_NS 200000
+INTERNAL void
+sleep_until_ns(u64 wake_ns)
+{
+  if (wake_ns > get_monotonic_ns() + SLEEP_SPIN_TAIL_NS)
+  {
+    u64 sleep_ns = wake_ns - SLEEP_SPIN_TAIL_NS;
+    struct timespec sleep_timespec = {};
+    sleep_timespec.tv_sec = sleep_ns / BILLION;
+    sleep_timespec.tv_nsec = sleep_ns % BILLION;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sleep_timespec, NULL) == EINTR) {}
+  }
+  while (get_monotonic_ns() < wake_ns) _mm_pause();
+}
+
+// NOTE(Ryan): Present UST/MSC timestamps give when the last vblank happened and how far 
+// apart they are. Frame work starts as late as it can while still making the next one, 
+// so input is as fresh as possible
+#define FRAME_PACER_SAFETY_MARGIN_NS 1500000
+struct FramePacer
+{
+  u64 vblank_period_ns;
+  u64 last_vblank_ns;
+  u64 last_msc;
+  u64 target_msc;
+  u64 work_estimate_ns;
+  u32 num_missed_frames;
+};
+
+INTERNAL void
+frame_pacer_complete(FramePacer *pacer, u64 ust, u64 msc)
+{
+  // NOTE(Ryan): UST is microseconds on CLOCK_MONOTONIC
+  u64 vblank_ns = ust * 1000;
+
+  if (pacer->last_msc != 0 && msc > pacer->last_msc && vblank_ns > pacer->last_vblank_ns)
+  {
+    u64 measured_period_ns = (vblank_ns - pacer->last_vblank_ns) / (msc - pacer->last_msc);
+    // NOTE(Ryan): Ignore gaps from e.g. being unmapped or the crtc changing mode
+    if (measured_period_ns > pacer->vblank_period_ns / 2 && 
+        measured_period_ns < pacer->vblank_period_ns * 2)
+    {
+      pacer->vblank_period_ns = (7 * pacer->vblank_period_ns + measured_period_ns) / 8;
+    }
+  }
+
+  if (pacer->target_msc != 0 && msc > pacer->target_msc)
+  {
+    pacer->num_missed_frames += (u32)(msc - pacer->target_msc);
+  }
+
+  pacer->last_vblank_ns = vblank_ns;
+  pacer->last_msc = msc;
+  pacer->target_msc = msc + 1;
+}
+
+INTERNAL u64
+frame_pacer_wake_ns(FramePacer *pacer)
+{
+  u64 next_vblank_ns = pacer->last_vblank_ns + pacer->vblank_period_ns;
+  u64 lead_ns = pacer->work_estimate_ns + FRAME_PACER_SAFETY_MARGIN_NS;
+  if (next_vblank_ns < lead_ns) return 0;
+  return next_vblank_ns - lead_ns;
+}
+
+INTERNAL void
+frame_pacer_record_work(FramePacer *pacer, u64 work_ns)
+{
+  // NOTE(Ryan): Jump up to spikes immediately, decay slowly so one fast frame doesn't 
+  // make the next start too late
+  if (work_ns > pacer->work_estimate_ns) pacer->work_estimate_ns = work_ns;
+  else pacer->work_estimate_ns -= (pacer->work_estimate_ns - work_ns) / 16;
+}
+
 struct XlibPresentPixmap
 {
   Pixmap pixmap;
@@ -287,6 +523,7 @@ xlib_create_back_buffer(Display *display, XVisualInfo visual_info, Window window
 { 
   XlibBackBuffer back_buffer = {};
   back_buffer.visual_info = visual_info;
+  ASSERT(width <= HHF_BACK_BUFFER_MAX_WIDTH && height <= HHF_BACK_BUFFER_MAX_HEIGHT);
 
   int bytes_per_pixel = 4;
   int fd = -1;
@@ -317,12 +554,19 @@ xlib_create_back_buffer(Display *display, XVisualInfo visual_info, Window window
   return back_buffer;
 }
 
+// NOTE(Ryan): Only the dirty rects are sent to the server, scaled up to the window and presented.
+// Passing NULL uploads everything
 INTERNAL void
 xrender_xpresent_back_buffer(Display *display, Window window, GC gc, RRCrtc crtc, 
-                             XlibBackBuffer *back_buffer, int window_width, int window_height)
+                             XlibBackBuffer *back_buffer, int window_width, int window_height,
+                             HHFRect *dirty_rects, int num_dirty_rects, u64 target_msc)
 {
-  XPutImage(display, back_buffer->pixmap, gc, back_buffer->image, 
-          0, 0, 0, 0, back_buffer->width, back_buffer->height);
+  HHFRect full_rect = {0, 0, back_buffer->width, back_buffer->height};
+  if (dirty_rects == NULL)
+  {
+    dirty_rects = &full_rect;
+    num_dirty_rects = 1;
+  }
 
   if (back_buffer->present_pixmap.width != window_width ||
       back_buffer->present_pixmap.height != window_height)
@@ -330,16 +574,53 @@ xrender_xpresent_back_buffer(Display *display, Window window, GC gc, RRCrtc crtc
     xlib_back_buffer_update_present_pixmap(display, window, back_buffer, window_width, 
                                            window_height);
     xlib_back_buffer_update_render_pict(display, back_buffer, window_width, window_height);
+
+    // IMPORTANT(Ryan): New present pixmap has undefined contents, so must be fully composited
+    XRenderComposite(display, PictOpSrc, back_buffer->render_pict.src_pict, 0, 
+                     back_buffer->render_pict.dst_pict, 0, 0, 0, 0, 0, 0,
+                     window_width, window_height);
   }
-  
-  XRenderComposite(display, PictOpSrc, back_buffer->render_pict.src_pict, 0, 
-                   back_buffer->render_pict.dst_pict, 0, 0, 0, 0, 0, 0,
-                   window_width, window_height);
+
+  XRectangle window_rects[HHF_BACK_BUFFER_MAX_DIRTY_RECTS] = {};
+  ASSERT(num_dirty_rects <= HHF_BACK_BUFFER_MAX_DIRTY_RECTS);
+  for (int rect_i = 0; rect_i < num_dirty_rects; ++rect_i)
+  {
+    HHFRect *rect = &dirty_rects[rect_i];
+    XPutImage(display, back_buffer->pixmap, gc, back_buffer->image, 
+              rect->min_x, rect->min_y, rect->min_x, rect->min_y, 
+              rect->max_x - rect->min_x, rect->max_y - rect->min_y);
+
+    // NOTE(Ryan): Round outwards, with a pixel of margin for the scaling filter.
+    // Source coordinates are in window space as the source picture transform does the scaling
+    int window_min_x = (rect->min_x * window_width) / back_buffer->width - 1;
+    int window_min_y = (rect->min_y * window_height) / back_buffer->height - 1;
+    int window_max_x = (rect->max_x * window_width + back_buffer->width - 1) / 
+                         back_buffer->width + 1;
+    int window_max_y = (rect->max_y * window_height + back_buffer->height - 1) / 
+                         back_buffer->height + 1;
+    if (window_min_x < 0) window_min_x = 0;
+    if (window_min_y < 0) window_min_y = 0;
+    if (window_max_x > window_width) window_max_x = window_width;
+    if (window_max_y > window_height) window_max_y = window_height;
+
+    XRectangle *window_rect = &window_rects[rect_i];
+    window_rect->x = window_min_x;
+    window_rect->y = window_min_y;
+    window_rect->width = window_max_x - window_min_x;
+    window_rect->height = window_max_y - window_min_y;
+
+    XRenderComposite(display, PictOpSrc, back_buffer->render_pict.src_pict, 0, 
+                     back_buffer->render_pict.dst_pict, window_rect->x, window_rect->y, 0, 0,
+                     window_rect->x, window_rect->y, window_rect->width, window_rect->height);
+  }
+
+  // NOTE(Ryan): Still present with an empty region, as the completion drives our frame loop
+  XFixesSetRegion(display, back_buffer->present_pixmap.region, window_rects, num_dirty_rects);
   
   XPresentPixmap(display, window, back_buffer->present_pixmap.pixmap, 
                  back_buffer->present_pixmap.serial++, 
                  None, back_buffer->present_pixmap.region, 0, 0, crtc, None, None, 
-                 PresentOptionNone, 0, 1, 0, NULL, 0);
+                 PresentOptionNone, target_msc, 0, 0, NULL, 0);
 }
 
 struct XrandrActiveCRTC
@@ -385,16 +666,18 @@ xrandr_get_active_crtc(Display *display, Window root_window)
   return active_crtc;
 }
 
+// NOTE(Ryan): Compared against the current state rather than last frame's, so a press and 
+// release within the same frame still counts both transitions
 INTERNAL void
 udev_process_digital_button(HHFInputButtonState *prev_button_state,
                              HHFInputButtonState *cur_button_state,
                              bool ended_down)
 {
-  cur_button_state->ended_down = ended_down;
-  if (cur_button_state->ended_down != prev_button_state->ended_down)
+  if (cur_button_state->ended_down != ended_down)
   {
     cur_button_state->half_transition_count++;
   }
+  cur_button_state->ended_down = ended_down;
 }
 
 INTERNAL void
@@ -420,58 +703,13 @@ udev_process_analog_button(HHFInputButtonState *prev_button_state_neg,
 }
 
 
-//INTERVAL void
-//udev_check_hotplug_devices(struct udev_monitor *monitor,
-//                           UdevPollDevice poll_devices[MAX_PROCESS_FDS], 
-//                           UdevHotplugDevice hotplug_devices[MAX_UDEV_DEVICES])
-//{
-//   int hotplug_fd = udev_monitor_get_fd(monitor);
-//   int have_hotplug = 0;
-//   do
-//   {
-//     struct pollfd udev_poll = {};
-//     udev_poll.fd = hotplug_fd;
-//     udev_poll.events = POLLIN | POLLPRI;
-//     have_hotplug = poll(&udev_poll, 1, 0);
-//   } while (have_hotplug < 0 && errno == EINTR);
-//
-//   if (have_hotplug)
-//   {
-//     struct udev_device *dev = udev_monitor_receive_device(monitor);
-//     const char *action = udev_device_get_action(dev);
-//     if (strcmp(action, "add") == 0)
-//     {
-//       udev_possibly_add_device(epoll_fd, dev, poll_devices, hotplug_devices);  
-//     }
-//     if (strcmp(action, "remove") == 0)
-//     {
-//       // TODO(Ryan): What to do when this is NULL? perhaps its sys first then dev?
-//       const char *dev_path = udev_device_get_devnode(dev);
-//       if (dev_path == NULL) BP(NULL); // call again?
-//       for (int hotplug_device_i = 0; 
-//            hotplug_device_i < MAX_UDEV_DEVICES;
-//            ++hotplug_device_i)
-//       {
-//         UdevHotplugDevice h_dev = hotplug_devices[hotplug_device_i];
-//         if (strcmp(h_dev.dev_path, dev_path) == 0)
-//         {
-//           udev_hotplug_devices[hotplug_device_i] = {};
-//           close(h_dev.fd);
-//           udev_poll_devices[h_dev.fd] = UDEV_DEVICE_TYPE_IGNORE;
-//         }
-//       }
-//     }
-//     udev_device_unref(dev);
-//   }
-//}
-
 struct RecordingState
 {
   bool are_recording;
   bool are_playing;
 
   void *mem;
-  int mem_size;
+  u64 mem_size;
 
   void *input;
   int max_input_size;
@@ -479,35 +717,133 @@ struct RecordingState
   int input_bytes_read;
 };
 
+// NOTE(Ryan): Devices are read in turn, so an event from one can be queued behind a newer 
+// event from another. Every event up to the timestamp is popped regardless of position. One 
+// found behind newer events is taken out, and those newer events shift up a slot in order. 
+// Slots from read_i up to write_i are the consumer's until read_i is released, so the 
+// producer never sees the shift
+INTERNAL bool
+input_event_queue_pop(InputEventQueue *queue, u64 up_to_ns, InputEvent *event)
+{
+  bool result = false;
+
+  u32 read_i = queue->read_i;
+  u32 write_i = __atomic_load_n(&queue->write_i, __ATOMIC_ACQUIRE);
+  for (u32 event_i = read_i; event_i != write_i; ++event_i)
+  {
+    InputEvent *next_event = &queue->events[event_i & (INPUT_EVENT_QUEUE_SIZE - 1)];
+    if (next_event->time_ns <= up_to_ns)
+    {
+      *event = *next_event;
+      for (u32 shift_i = event_i; shift_i != read_i; --shift_i)
+      {
+        queue->events[shift_i & (INPUT_EVENT_QUEUE_SIZE - 1)] = 
+          queue->events[(shift_i - 1) & (INPUT_EVENT_QUEUE_SIZE - 1)];
+      }
+      __atomic_store_n(&queue->read_i, read_i + 1, __ATOMIC_RELEASE);
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(Ryan): Blocks until any device is readable, then drains every pending event so 
+// nothing is lost or delayed by how often frames poll
+INTERNAL void *
+input_thread_proc(void *arg)
+{
+  InputThreadContext *context = (InputThreadContext *)arg;
+
+  while (true)
+  {
+    struct epoll_event epoll_events[EPOLL_UDEV_MAX_EVENTS] = {0};
+    int num_epoll_events = epoll_wait(context->epoll_fd, epoll_events, 
+                                      EPOLL_UDEV_MAX_EVENTS, -1);
+    if (num_epoll_events == -1)
+    {
+      if (errno == EINTR) continue;
+      EBP(NULL);
+    }
+
+    for (int epoll_event_i = 0; epoll_event_i < num_epoll_events; ++epoll_event_i)
+    {
+      int dev_fd = epoll_events[epoll_event_i].data.fd;
+      if (dev_fd == context->udev_monitor_fd)
+      {
+        udev_check_hotplug_devices(context);
+        continue;
+      }
+      UdevPollDevice *dev = &context->poll_devices[dev_fd];
+
+      while (true)
+      {
+        struct input_event dev_events[64] = {0};
+        int dev_event_bytes_read = read(dev_fd, dev_events, sizeof(dev_events));
+        if (dev_event_bytes_read == -1)
+        {
+          // NOTE(Ryan): Unplugging gives ENODEV before the udev remove arrives
+          if (errno != EAGAIN && errno != ENODEV) EBP(NULL);
+          break;
+        }
+
+        int num_dev_events = dev_event_bytes_read / sizeof(dev_events[0]); 
+        for (int dev_event_i = 0; dev_event_i < num_dev_events; ++dev_event_i)
+        {
+          struct input_event *dev_event = &dev_events[dev_event_i];
+          if (dev_event->type == EV_SYN) continue;
+
+          InputEvent event = {};
+          event.time_ns = (BILLION * (u64)dev_event->input_event_sec) + 
+                          (1000 * (u64)dev_event->input_event_usec);
+          event.hhf_i = dev->hhf_i;
+          event.type = dev_event->type;
+          event.code = dev_event->code;
+          event.value = dev_event->value;
+          input_event_queue_push(context->queue, &event);
+        }
+
+        if (num_dev_events < (int)ARRAY_LEN(dev_events)) break;
+      }
+    }
+  }
+
+  return NULL;
+}
+
 INTERNAL void
-udev_check_poll_devices(int epoll_fd, UdevPollDevice poll_devices[MAX_PROCESS_FDS], 
-                        HHFInput *prev_input, HHFInput *cur_input,
-                        XlibInfo *info, HHFMemory *hhf_memory, RecordingState *recording_state)
+udev_process_input_events(InputEventQueue *queue, u64 up_to_ns, bool want_to_apply,
+                          HHFInput *prev_input, HHFInput *cur_input,
+                          XlibInfo *info, HHFMemory *hhf_memory, RecordingState *recording_state)
 {
-  struct epoll_event epoll_events[EPOLL_UDEV_MAX_EVENTS] = {0};
-  int num_epoll_events = epoll_wait(epoll_fd, epoll_events, EPOLL_UDEV_MAX_EVENTS, 0);
-  for (int epoll_event_i = 0; epoll_event_i < num_epoll_events; ++epoll_event_i)
+  InputEvent event = {};
+  while (input_event_queue_pop(queue, up_to_ns, &event))
   {
-    int dev_fd = epoll_events[epoll_event_i].data.fd;
-    UdevPollDevice dev = poll_devices[dev_fd];
+    if (event.type == INPUT_EVENT_TYPE_CONNECTED || event.type == INPUT_EVENT_TYPE_DISCONNECTED)
+    {
+      // NOTE(Ryan): Slot may be reused by a different device, so start from nothing
+      HHFInputController *cur_controller = &cur_input->controllers[event.hhf_i];
+      HHFInputController *prev_controller = &prev_input->controllers[event.hhf_i];
+      *cur_controller = {};
+      *prev_controller = {};
+      cur_controller->is_connected = (event.type == INPUT_EVENT_TYPE_CONNECTED);
+      cur_controller->is_analog = (event.value != 0);
+      continue;
+    }
 
-    struct input_event dev_events[4] = {0};
-    int dev_event_bytes_read = read(dev_fd, dev_events, sizeof(dev_events));
-    if (dev_event_bytes_read == -1) EBP(NULL);
+    // NOTE(Ryan): Still drained when unfocused, so keys pressed elsewhere aren't replayed later
+    if (!want_to_apply) continue;
 
-    int num_dev_events = dev_event_bytes_read / sizeof(dev_events[0]); 
-    for (int dev_event_i = 0; dev_event_i < num_dev_events; ++dev_event_i)
     {
-      u16 dev_event_type = dev_events[dev_event_i].type;
-      u16 dev_event_code = dev_events[dev_event_i].code;
-      s32 dev_event_value = dev_events[dev_event_i].value;
+      u16 dev_event_type = event.type;
+      u16 dev_event_code = event.code;
+      s32 dev_event_value = event.value;
 
       //if (dev_event_type == EV_KEY)
       //{
       //   printf("type: %" PRIu16 " code: %" PRIu16 ", value: %" PRId32"\n", dev_event_type, dev_event_code, dev_event_value);
       //}
-      
-      if (dev_event_type == EV_SYN) continue;
 
       bool was_released = (dev_event_type == EV_KEY ? dev_event_value == 0 : false);
       bool first_down = (dev_event_type == EV_KEY ? dev_event_value == 1 : false);
@@ -549,8 +885,8 @@ udev_check_poll_devices(int epoll_fd, UdevPollDevice poll_devices[MAX_PROCESS_FD
       }
       if (dev_event_code == REL_WHEEL) cur_input->mouse_wheel += dev_event_value;
 
-      HHFInputController *cur_controller_state = &cur_input->controllers[dev.hhf_i];
-      HHFInputController *prev_controller_state = &prev_input->controllers[dev.hhf_i];
+      HHFInputController *cur_controller_state = &cur_input->controllers[event.hhf_i];
+      HHFInputController *prev_controller_state = &prev_input->controllers[event.hhf_i];
 
       // TODO(Ryan): Gamepad cannot vibrate
       if (dev_event_code == BTN_DPAD_LEFT || dev_event_code == KEY_A)
@@ -681,6 +1017,16 @@ udev_check_poll_devices(int epoll_fd, UdevPollDevice poll_devices[MAX_PROCESS_FD
 
       if (dev_event_code == KEY_F5) want_to_run = false;
 
+      if (dev_event_code == KEY_F1 && first_down)
+      {
+        hhf_memory->debug_overlay_is_visible = !hhf_memory->debug_overlay_is_visible;
+      }
+      if (dev_event_code == KEY_F2 && first_down)
+      {
+        hhf_memory->debug_checks_are_enabled = !hhf_memory->debug_checks_are_enabled;
+      }
+      if (dev_event_code == KEY_F3 && first_down) hhf_memory->debug_want_benchmarks = true;
+
       if (dev_event_code == KEY_R && first_down)
       {
         if (!recording_state->are_recording)
@@ -746,118 +1092,560 @@ playback_input(RecordingState *recording_state, HHFInput **input)
   recording_state->input_bytes_read += sizeof(*input);
 }
 
+HHFPlatformMappedFile
+hhf_platform_map_file(HHFThreadContext *thread_context, char *file_name)
+{
+  HHFPlatformMappedFile result = {0};
+
+  struct stat file_status = {0};
+  void *mmap_res = NULL;
+
+  int file_fd = open(file_name, O_RDONLY); 
+  if (file_fd < 0) 
+  {
+    result.errno_code = errno; 
+    goto end;
+  }
+
+  if (fstat(file_fd, &file_status) < 0) 
+  {
+    EBP(NULL);
+    result.errno_code = errno; 
+    goto end_open;
+  }
+  if (file_status.st_size == 0)
+  {
+    result.errno_code = EINVAL;
+    goto end_open;
+  }
+
+  // NOTE(Ryan): Mapping stays valid once the descriptor is closed
+  mmap_res = mmap(NULL, file_status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_fd, 0);
+  if (mmap_res == MAP_FAILED)
+  {
+    EBP(NULL);
+    result.errno_code = errno;
+    goto end_open;
+  }
+  result.memory = mmap_res;
+  result.size = file_status.st_size;
+
+end_open:
+  close(file_fd); 
+end:
+  return result;
+}
+
 void
-hhf_platform_free_read_file_result(HHFThreadContext *thread_context, HHFPlatformReadFileResult *file_result)
+hhf_platform_unmap_file(HHFThreadContext *thread_context, HHFPlatformMappedFile *mapped_file)
 {
-  free(file_result->contents);
+  if (mapped_file->memory != NULL) munmap(mapped_file->memory, mapped_file->size);
+  mapped_file->memory = NULL;
+  mapped_file->size = 0;
 }
 
-// TODO(Ryan): Remove blocking and add write protection (writing to intermediate file)
-int
-hhf_platform_write_entire_file(HHFThreadContext *thread_context, char *file_name, void *memory, u64 size)
+// NOTE(Ryan): Reads go through io_uring when the kernel allows it, otherwise to a small pool of
+// worker threads doing pread(). Requests and the ring are only touched by the game thread
+#define MAX_IO_REQUESTS 256
+#define IO_URING_NUM_ENTRIES 64
+#define IO_NUM_WORKER_THREADS 2
+
+enum IO_REQUEST_TYPE
+{
+  IO_REQUEST_TYPE_NONE = 0,
+  IO_REQUEST_TYPE_READ,
+  IO_REQUEST_TYPE_WRITE_FILE,
+};
+
+struct IORequest
+{
+  IO_REQUEST_TYPE type;
+  u32 generation;
+  // NOTE(Ryan): Written last by whoever completes the request
+  HHF_IO_STATUS status;
+  int errno_code;
+
+  int fd;
+  u64 offset;
+  u64 size;
+  u8 *dest;
+  u64 bytes_done;
+  struct iovec iovec;
+  bool is_on_worker;
+
+  char file_name[256];
+};
+
+struct IOUring
 {
-  int result = 0;
+  int fd;
+  u32 *sq_head, *sq_tail, *sq_mask, *sq_array;
+  u32 sq_num_entries;
+  struct io_uring_sqe *sqes;
+  u32 *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+};
 
-  size_t bytes_to_write = 0;
-  u8 *byte_location = NULL;
-  int file_fd = 0;
+struct IOSystem
+{
+  IORequest requests[MAX_IO_REQUESTS];
+  u32 free_request_indices[MAX_IO_REQUESTS];
+  u32 num_free_requests;
+
+  bool have_io_uring;
+  IOUring ring;
+
+  pthread_mutex_t job_mutex;
+  pthread_cond_t job_cond;
+  pthread_cond_t done_cond;
+  u32 jobs[MAX_IO_REQUESTS];
+  u32 job_read_i, job_write_i;
+  pthread_t workers[IO_NUM_WORKER_THREADS];
+};
 
-  int open_res = open(file_name, O_CREAT | O_WRONLY | O_TRUNC, 0777); 
-  if (open_res < 0) 
+GLOBAL IOSystem global_io_system;
+
+INTERNAL bool
+io_uring_initialise(IOUring *ring)
+{
+  struct io_uring_params params = {};
+  int ring_fd = syscall(__NR_io_uring_setup, IO_URING_NUM_ENTRIES, &params);
+  // NOTE(Ryan): ENOSYS on old kernels, EPERM when disabled by sysctl or a seccomp sandbox
+  if (ring_fd == -1) return false;
+
+  size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+  size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool is_single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+  if (is_single_mmap && cq_ring_size > sq_ring_size) sq_ring_size = cq_ring_size;
+
+  u8 *sq_ring = (u8 *)mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, 
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED)
   {
-    EBP(NULL);
-    result = errno;
-    goto end;
+    close(ring_fd);
+    return false;
+  }
+  u8 *cq_ring = sq_ring;
+  if (!is_single_mmap)
+  {
+    cq_ring = (u8 *)mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, 
+                         MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED)
+    {
+      close(ring_fd);
+      return false;
+    }
+  }
+  ring->sqes = (struct io_uring_sqe *)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), 
+                                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+                                           ring_fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+  {
+    close(ring_fd);
+    return false;
   }
-  file_fd = open_res;
 
-  bytes_to_write = size;
-  byte_location = (u8 *)memory;
-  while (bytes_to_write > 0) 
+  ring->fd = ring_fd;
+  ring->sq_head = (u32 *)(sq_ring + params.sq_off.head);
+  ring->sq_tail = (u32 *)(sq_ring + params.sq_off.tail);
+  ring->sq_mask = (u32 *)(sq_ring + params.sq_off.ring_mask);
+  ring->sq_array = (u32 *)(sq_ring + params.sq_off.array);
+  ring->sq_num_entries = params.sq_entries;
+  ring->cq_head = (u32 *)(cq_ring + params.cq_off.head);
+  ring->cq_tail = (u32 *)(cq_ring + params.cq_off.tail);
+  ring->cq_mask = (u32 *)(cq_ring + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+  return true;
+}
+
+INTERNAL bool
+io_uring_submit_read(IOUring *ring, IORequest *request, u32 request_i)
+{
+  u32 tail = *ring->sq_tail;
+  u32 head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (tail - head == ring->sq_num_entries) return false;
+
+  request->iovec.iov_base = request->dest + request->bytes_done;
+  request->iovec.iov_len = request->size - request->bytes_done;
+
+  // NOTE(Ryan): READV rather than READ as it goes back to the first io_uring kernels
+  u32 sqe_i = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[sqe_i];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = request->fd;
+  sqe->off = request->offset + request->bytes_done;
+  sqe->addr = (u64)&request->iovec;
+  sqe->len = 1;
+  sqe->user_data = request_i;
+  ring->sq_array[sqe_i] = sqe_i;
+
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  int num_submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+  if (num_submitted != 1) EBP(NULL);
+
+  return true;
+}
+
+INTERNAL void
+io_push_worker_job(IOSystem *io, u32 request_i)
+{
+  io->requests[request_i].is_on_worker = true;
+  pthread_mutex_lock(&io->job_mutex);
+  io->jobs[io->job_write_i++ % MAX_IO_REQUESTS] = request_i;
+  pthread_cond_signal(&io->job_cond);
+  pthread_mutex_unlock(&io->job_mutex);
+}
+
+INTERNAL void
+io_uring_reap_completions(IOSystem *io)
+{
+  IOUring *ring = &io->ring;
+  u32 head = *ring->cq_head;
+  u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head)
   {
-    int write_res = write(file_fd, byte_location, bytes_to_write); 
-    if (write_res < 0) 
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    u32 request_i = (u32)cqe->user_data;
+    IORequest *request = &io->requests[request_i];
+
+    if (cqe->res < 0)
     {
-      EBP(NULL);
-      result = errno;
-      goto end_open;
+      request->errno_code = -cqe->res;
+      request->status = HHF_IO_STATUS_FAILED;
+    }
+    else if (cqe->res == 0)
+    {
+      // NOTE(Ryan): Range went past the end of the file
+      request->errno_code = EIO;
+      request->status = HHF_IO_STATUS_FAILED;
     }
     else
     {
-      int bytes_written = write_res;
-      bytes_to_write -= bytes_written;
-      byte_location += bytes_written;
+      request->bytes_done += cqe->res;
+      if (request->bytes_done == request->size)
+      {
+        request->status = HHF_IO_STATUS_COMPLETE;
+      }
+      // NOTE(Ryan): Short reads are allowed, so continue from where it stopped
+      else if (!io_uring_submit_read(ring, request, request_i))
+      {
+        io_push_worker_job(io, request_i);
+      }
     }
   }
-end_open:
-  close(file_fd); 
-end:
-  return result;
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
 }
 
-// TODO(Ryan): Remove dynamic memory allocation here and obtain from memory pool
-// Avoid round tripping by writing to a queue
-// Introduce streaming, i.e background loading
-HHFPlatformReadFileResult
-hhf_platform_read_entire_file(HHFThreadContext *thread_context, char *file_name)
+INTERNAL void
+io_worker_read(IORequest *request)
 {
-  HHFPlatformReadFileResult result = {0};
+  while (request->bytes_done < request->size)
+  {
+    ssize_t read_res = pread(request->fd, request->dest + request->bytes_done, 
+                             request->size - request->bytes_done, 
+                             request->offset + request->bytes_done);
+    if (read_res == -1 && errno == EINTR) continue;
+    if (read_res <= 0)
+    {
+      request->errno_code = (read_res == 0 ? EIO : errno);
+      __atomic_store_n(&request->status, HHF_IO_STATUS_FAILED, __ATOMIC_RELEASE);
+      return;
+    }
+    request->bytes_done += read_res;
+  }
+  __atomic_store_n(&request->status, HHF_IO_STATUS_COMPLETE, __ATOMIC_RELEASE);
+}
 
-  // IMPORTANT(Ryan): Require forward declarations to avoid g++ error of jumping over init
-  size_t bytes_to_read = 0;
-  u8 *byte_location = NULL;
-  int file_fd = 0, fstat_res = 0;
-  struct stat file_status = {0};
+// NOTE(Ryan): Written beside the target, flushed, then renamed over it. A crash at any point 
+// leaves either the old or the new file, never a torn one.
+// Each write has its own temporary, so concurrent writes to one path don't share a file.
+// The last rename wins
+INTERNAL void
+io_worker_write_file(IORequest *request)
+{
+  char temp_file_name[sizeof(request->file_name) + 8] = {};
+  snprintf(temp_file_name, sizeof(temp_file_name), "%s.XXXXXX", request->file_name);
 
-  int open_res = open(file_name, O_RDONLY); 
-  if (open_res < 0) 
+  int file_fd = mkostemp(temp_file_name, O_CLOEXEC);
+  if (file_fd == -1)
   {
-    EBP(NULL);
-    result.errno_code = errno; 
-    goto end;
+    request->errno_code = errno;
+    __atomic_store_n(&request->status, HHF_IO_STATUS_FAILED, __ATOMIC_RELEASE);
+    return;
   }
-  file_fd = open_res;
+  // NOTE(Ryan): mkostemp() creates with 0600, which rename would carry over to the target
+  fchmod(file_fd, 0644);
 
-  fstat_res = fstat(file_fd, &file_status);
-  if (fstat_res < 0) 
+  while (request->bytes_done < request->size)
   {
-    EBP(NULL);
-    result.errno_code = errno; 
-    goto end_open;
+    ssize_t write_res = write(file_fd, request->dest + request->bytes_done, 
+                              request->size - request->bytes_done);
+    if (write_res == -1)
+    {
+      if (errno == EINTR) continue;
+      request->errno_code = errno;
+      break;
+    }
+    request->bytes_done += write_res;
   }
 
-  result.contents = malloc(file_status.st_size);
-  if (result.contents == NULL)
+  if (request->errno_code == 0 && fsync(file_fd) == -1) request->errno_code = errno;
+  close(file_fd);
+
+  if (request->errno_code == 0 && rename(temp_file_name, request->file_name) == -1)
+  {
+    request->errno_code = errno;
+  }
+
+  if (request->errno_code != 0)
+  {
+    unlink(temp_file_name);
+    __atomic_store_n(&request->status, HHF_IO_STATUS_FAILED, __ATOMIC_RELEASE);
+    return;
+  }
+
+  // NOTE(Ryan): Rename itself is only durable once the directory is flushed
+  char dir_name[sizeof(request->file_name)] = {};
+  strcpy(dir_name, request->file_name);
+  char *last_slash = strrchr(dir_name, '/');
+  if (last_slash != NULL) *last_slash = '\0';
+  int dir_fd = open(last_slash != NULL ? dir_name : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd != -1)
+  {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+
+  __atomic_store_n(&request->status, HHF_IO_STATUS_COMPLETE, __ATOMIC_RELEASE);
+}
+
+INTERNAL void *
+io_worker_thread_proc(void *arg)
+{
+  IOSystem *io = (IOSystem *)arg;
+
+  while (true)
+  {
+    pthread_mutex_lock(&io->job_mutex);
+    while (io->job_read_i == io->job_write_i) pthread_cond_wait(&io->job_cond, &io->job_mutex);
+    u32 request_i = io->jobs[io->job_read_i++ % MAX_IO_REQUESTS];
+    pthread_mutex_unlock(&io->job_mutex);
+
+    IORequest *request = &io->requests[request_i];
+    if (request->type == IO_REQUEST_TYPE_READ) io_worker_read(request);
+    if (request->type == IO_REQUEST_TYPE_WRITE_FILE) io_worker_write_file(request);
+
+    // NOTE(Ryan): Lock so a waiter can't miss the wakeup between checking and sleeping
+    pthread_mutex_lock(&io->job_mutex);
+    pthread_cond_broadcast(&io->done_cond);
+    pthread_mutex_unlock(&io->job_mutex);
+  }
+
+  return NULL;
+}
+
+INTERNAL void
+io_system_initialise(IOSystem *io)
+{
+  for (u32 request_i = 0; request_i < MAX_IO_REQUESTS; ++request_i)
+  {
+    io->free_request_indices[io->num_free_requests++] = MAX_IO_REQUESTS - 1 - request_i;
+  }
+
+  io->have_io_uring = io_uring_initialise(&io->ring);
+
+  pthread_mutex_init(&io->job_mutex, NULL);
+  pthread_cond_init(&io->job_cond, NULL);
+  pthread_cond_init(&io->done_cond, NULL);
+  for (int worker_i = 0; worker_i < IO_NUM_WORKER_THREADS; ++worker_i)
+  {
+    if (pthread_create(&io->workers[worker_i], NULL, io_worker_thread_proc, io) != 0) EBP(NULL);
+  }
+}
+
+INTERNAL IORequest *
+io_get_request(IOSystem *io, HHFPlatformIORequest *handle, u32 *request_i)
+{
+  IORequest *result = NULL;
+
+  *request_i = handle->id & 0xFFFF;
+  if (*request_i < MAX_IO_REQUESTS) 
+  {
+    IORequest *request = &io->requests[*request_i];
+    if (request->type != IO_REQUEST_TYPE_NONE && request->generation == (handle->id >> 16))
+    {
+      result = request;
+    }
+  }
+
+  return result;
+}
+
+INTERNAL HHF_IO_STATUS
+io_retire_if_done(IOSystem *io, IORequest *request, u32 request_i, HHFPlatformIORequest *handle)
+{
+  HHF_IO_STATUS result = __atomic_load_n(&request->status, __ATOMIC_ACQUIRE);
+  if (result != HHF_IO_STATUS_PENDING)
+  {
+    handle->errno_code = request->errno_code;
+    request->type = IO_REQUEST_TYPE_NONE;
+    io->free_request_indices[io->num_free_requests++] = request_i;
+  }
+  return result;
+}
+
+INTERNAL IORequest *
+io_begin_request(IOSystem *io, IO_REQUEST_TYPE type, HHFPlatformIORequest *handle, u32 *request_i)
+{
+  *request_i = io->free_request_indices[--io->num_free_requests];
+  IORequest *result = &io->requests[*request_i];
+  u32 generation = (result->generation + 1) & 0xFFFF;
+  if (generation == 0) generation = 1;
+  *result = {};
+  result->type = type;
+  result->generation = generation;
+  result->status = HHF_IO_STATUS_PENDING;
+  handle->id = (generation << 16) | *request_i;
+
+  return result;
+}
+
+HHFPlatformFile
+hhf_platform_open_file(HHFThreadContext *thread_context, char *file_name)
+{
+  HHFPlatformFile result = {};
+
+  int file_fd = open(file_name, O_RDONLY | O_CLOEXEC);
+  if (file_fd == -1)
   {
-    EBP(NULL);
     result.errno_code = errno;
-    goto end_open;
+    result.platform_handle = -1;
+  }
+  else
+  {
+    struct stat file_status = {};
+    if (fstat(file_fd, &file_status) == -1) EBP(NULL);
+    result.size = file_status.st_size;
+    result.platform_handle = file_fd;
   }
-  result.size = file_status.st_size;
 
-  bytes_to_read = file_status.st_size;
-  byte_location = (u8 *)result.contents;
-  while (bytes_to_read > 0) 
+  return result;
+}
+
+void
+hhf_platform_close_file(HHFThreadContext *thread_context, HHFPlatformFile *file)
+{
+  if (file->platform_handle != -1) close((int)file->platform_handle);
+  file->platform_handle = -1;
+}
+
+HHFPlatformIORequest
+hhf_platform_read_file_async(HHFThreadContext *thread_context, HHFPlatformFile *file, 
+                             u64 offset, u64 size, void *dest)
+{
+  HHFPlatformIORequest result = {};
+
+  IOSystem *io = &global_io_system;
+  if (file->platform_handle == -1 || io->num_free_requests == 0)
   {
-    int read_res = read(file_fd, byte_location, bytes_to_read); 
-    if (read_res < 0) 
+    result.errno_code = (file->platform_handle == -1 ? EBADF : EAGAIN);
+    return result;
+  }
+
+  u32 request_i = 0;
+  IORequest *request = io_begin_request(io, IO_REQUEST_TYPE_READ, &result, &request_i);
+  request->fd = (int)file->platform_handle;
+  request->offset = offset;
+  request->size = size;
+  request->dest = (u8 *)dest;
+
+  if (size == 0) request->status = HHF_IO_STATUS_COMPLETE;
+  else if (!io->have_io_uring || !io_uring_submit_read(&io->ring, request, request_i))
+  {
+    io_push_worker_job(io, request_i);
+  }
+
+  return result;
+}
+
+HHFPlatformIORequest
+hhf_platform_write_entire_file(HHFThreadContext *thread_context, char *file_name, void *memory, 
+                               u64 size)
+{
+  HHFPlatformIORequest result = {};
+
+  IOSystem *io = &global_io_system;
+  if (strlen(file_name) >= sizeof(io->requests[0].file_name) || io->num_free_requests == 0)
+  {
+    result.errno_code = (io->num_free_requests == 0 ? EAGAIN : ENAMETOOLONG);
+    return result;
+  }
+
+  u32 request_i = 0;
+  IORequest *request = io_begin_request(io, IO_REQUEST_TYPE_WRITE_FILE, &result, &request_i);
+  strcpy(request->file_name, file_name);
+  request->size = size;
+  request->dest = (u8 *)memory;
+  io_push_worker_job(io, request_i);
+
+  return result;
+}
+
+HHF_IO_STATUS
+hhf_platform_poll_io(HHFThreadContext *thread_context, HHFPlatformIORequest *handle)
+{
+  IOSystem *io = &global_io_system;
+  u32 request_i = 0;
+  IORequest *request = io_get_request(io, handle, &request_i);
+  if (request == NULL) 
+  {
+    if (handle->errno_code == 0) handle->errno_code = EINVAL;
+    return HHF_IO_STATUS_FAILED;
+  }
+
+  if (io->have_io_uring) io_uring_reap_completions(io);
+
+  return io_retire_if_done(io, request, request_i, handle);
+}
+
+HHF_IO_STATUS
+hhf_platform_wait_io(HHFThreadContext *thread_context, HHFPlatformIORequest *handle)
+{
+  IOSystem *io = &global_io_system;
+  u32 request_i = 0;
+  IORequest *request = io_get_request(io, handle, &request_i);
+  if (request == NULL) 
+  {
+    if (handle->errno_code == 0) handle->errno_code = EINVAL;
+    return HHF_IO_STATUS_FAILED;
+  }
+
+  // NOTE(Ryan): A request can move from the ring to a worker when resubmitting, so both are
+  // checked until it finishes
+  while (true)
+  {
+    if (io->have_io_uring) io_uring_reap_completions(io);
+
+    HHF_IO_STATUS status = io_retire_if_done(io, request, request_i, handle);
+    if (status != HHF_IO_STATUS_PENDING) return status;
+
+    if (!request->is_on_worker)
     {
-      EBP(NULL);
-      result.errno_code = errno;
-      free(result.contents);
-      goto end_open;
+      syscall(__NR_io_uring_enter, io->ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
     }
     else
     {
-      int bytes_read = read_res;
-      bytes_to_read -= bytes_read;
-      byte_location += bytes_read;
+      pthread_mutex_lock(&io->job_mutex);
+      if (__atomic_load_n(&request->status, __ATOMIC_ACQUIRE) == HHF_IO_STATUS_PENDING)
+      {
+        pthread_cond_wait(&io->done_cond, &io->job_mutex);
+      }
+      pthread_mutex_unlock(&io->job_mutex);
     }
   }
-end_open:
-  close(file_fd); 
-end:
-  return result;
 }
 
 void
@@ -891,17 +1679,122 @@ copy_file(char *src_file, char *dst_file)
 //  write(memory);
 //}
 
-// NOTE(Ryan): Not actually atomic, just ensuring that read and write in one go.
-// e.g. long long might require several instructions with lower and upper bits
-GLOBAL volatile sig_atomic_t want_to_reload_update_and_render = 1;
+typedef void (*hhf_update_and_render_t)(HHFThreadContext *, HHFBackBuffer *, HHFSoundBuffer *, HHFInput *, HHFMemory *, HHFPlatform *); 
 
-void
-signal_reload_update_and_render(int sig_num)
+// NOTE(Ryan): Watcher thread does the copy and dlopen, the frame only swaps pointers
+struct HotReloadState
+{
+  int inotify_fd;
+  int lib_watch_fd;
+  int asset_watch_fd;
+
+  char lib_name[32];
+  char temp_lib_locs[2][128];
+  int next_temp_lib_i;
+
+  // NOTE(Ryan): Function pointer is written before the library is published 
+  void *pending_lib;
+  hhf_update_and_render_t pending_update_and_render;
+
+  u32 asset_generation;
+};
+
+// IMPORTANT(Ryan): dlopen() returns the already loaded library for the same path, so copies
+// alternate between two names. The currently loaded one is never overwritten
+INTERNAL void *
+hot_reload_load_lib(HotReloadState *state, char *lib_loc, hhf_update_and_render_t *update_and_render)
 {
-  want_to_reload_update_and_render = 1;
+  char *temp_lib_loc = state->temp_lib_locs[state->next_temp_lib_i];
+  state->next_temp_lib_i = !state->next_temp_lib_i;
+
+  copy_file(lib_loc, temp_lib_loc);
+  // TODO(Ryan): Understand how executables and shared objects exist in memory
+  void *lib = dlopen(temp_lib_loc, RTLD_NOW);
+  if (lib == NULL) EBP(dlerror());
+  *update_and_render = (hhf_update_and_render_t)dlsym(lib, "hhf_update_and_render");
+  if (*update_and_render == NULL) EBP(dlerror());
+
+  return lib;
 }
 
-typedef void (*hhf_update_and_render_t)(HHFThreadContext *, HHFBackBuffer *, HHFSoundBuffer *, HHFInput *, HHFMemory *, HHFPlatform *); 
+struct HotReloadThreadContext
+{
+  HotReloadState *state;
+  char *lib_loc;
+};
+
+INTERNAL void *
+hot_reload_thread_proc(void *arg)
+{
+  HotReloadThreadContext *context = (HotReloadThreadContext *)arg;
+  HotReloadState *state = context->state;
+
+  while (true)
+  {
+    alignas(struct inotify_event) char events_buf[4096] = {};
+    int events_bytes_read = read(state->inotify_fd, events_buf, sizeof(events_buf));
+    if (events_bytes_read == -1)
+    {
+      if (errno == EINTR) continue;
+      EBP(NULL);
+    }
+
+    bool lib_changed = false;
+    bool assets_changed = false;
+    for (char *cursor = events_buf; cursor < events_buf + events_bytes_read; 
+         cursor += sizeof(struct inotify_event) + ((struct inotify_event *)cursor)->len)
+    {
+      struct inotify_event *event = (struct inotify_event *)cursor;
+      if (event->wd == state->lib_watch_fd && event->len > 0 && 
+          strcmp(event->name, state->lib_name) == 0)
+      {
+        lib_changed = true;
+      }
+      if (event->wd == state->asset_watch_fd) assets_changed = true;
+    }
+
+    if (assets_changed)
+    {
+      __atomic_add_fetch(&state->asset_generation, 1, __ATOMIC_RELEASE);
+    }
+
+    if (lib_changed)
+    {
+      // NOTE(Ryan): Previous library must be taken first, otherwise its temp copy, which 
+      // is about to become the old one, could still be in use
+      while (__atomic_load_n(&state->pending_lib, __ATOMIC_ACQUIRE) != NULL) usleep(1000);
+
+      hhf_update_and_render_t update_and_render = NULL;
+      void *lib = hot_reload_load_lib(state, context->lib_loc, &update_and_render);
+      state->pending_update_and_render = update_and_render;
+      __atomic_store_n(&state->pending_lib, lib, __ATOMIC_RELEASE);
+    }
+  }
+
+  return NULL;
+}
+
+#if defined(HHF_INTERNAL)
+// NOTE(Ryan): pa_simple_get_latency() is a blocking round trip to the server, so it's only 
+// asked every PULSE_LATENCY_QUERY_FRAMES frames. In between, playback is assumed to advance 
+// at the sample rate from the last answer
+#define PULSE_LATENCY_QUERY_FRAMES 30
+
+// NOTE(Ryan): Counters are shown by the F1 overlay rather than printed, which at 60Hz floods 
+// the terminal
+INTERNAL void
+end_debug_cycle_counters(HHFMemory *hhf_memory)
+{
+  for (int counter_i = 0; counter_i < DEBUG_CYCLE_COUNTER_COUNT; ++counter_i)
+  {
+    HHFDebugCycleCounter *counter = &hhf_memory->debug_cycle_counters[counter_i];
+    // NOTE(Ryan): Kept for the overlay, which draws during the next frame
+    hhf_memory->debug_prev_cycle_counters[counter_i] = *counter;
+    *counter = {};
+  }
+}
+#endif
+
 
 int
 main(int argc, char *argv[])
@@ -1014,10 +1907,11 @@ main(int argc, char *argv[])
   hhf_back_buffer.width = xlib_back_buffer.width;
   hhf_back_buffer.height = xlib_back_buffer.height;
   hhf_back_buffer.memory = xlib_back_buffer.memory;
+  hhf_back_buffer.needs_full_redraw = true;
 
   XrandrActiveCRTC xrandr_active_crtc = xrandr_get_active_crtc(xlib_display, 
                                                                xlib_root_window);
-  // TODO(Ryan): Have a max fps to prevent floating point going out.
+  // NOTE(Ryan): Only used to size audio writes now, simulation has its own fixed step
   r32 frame_dt = 1.0f / xrandr_active_crtc.refresh_rate;
 
   HHFInput hhf_cur_input = {}, hhf_prev_input = {};
@@ -1034,19 +1928,41 @@ main(int argc, char *argv[])
   // NOTE(Ryan): Mouse hardware only give relative events, so require Xlib to give us absolute
   hhf_cur_input.mouse_x = win_x;
   hhf_cur_input.mouse_y = win_y;
-  hhf_cur_input.frame_dt = frame_dt;
+  hhf_cur_input.sim_dt = 1.0f / HHF_SIM_TICKS_PER_SECOND;
 
   struct udev *udev_obj = udev_new();
   if (udev_obj == NULL) BP(NULL);
 
-  //UdevHotplugDevice udev_hotplug_devices[MAX_UDEV_DEVICES] = {};
   UdevPollDevice udev_poll_devices[MAX_PROCESS_FDS] = {};
   int epoll_udev_fd = epoll_create1(0);
-  udev_populate_devices(udev_obj, epoll_udev_fd, udev_poll_devices, &hhf_cur_input);
 
-  //struct udev_monitor *udev_mon = udev_monitor_new_from_netlink(udev_obj, "udev");
-  //udev_monitor_filter_add_match_subsystem_devtype(udev_mon, "input", NULL);
-  //udev_monitor_enable_receiving(udev_mon);
+  InputEventQueue *input_event_queue = (InputEventQueue *)calloc(1, sizeof(InputEventQueue));
+  if (input_event_queue == NULL) EBP(NULL);
+  InputThreadContext input_thread_context = {};
+  input_thread_context.epoll_fd = epoll_udev_fd;
+  input_thread_context.poll_devices = udev_poll_devices;
+  input_thread_context.queue = input_event_queue;
+
+  // NOTE(Ryan): Monitor before enumerating, so a device plugged in between isn't missed
+  struct udev_monitor *udev_mon = udev_monitor_new_from_netlink(udev_obj, "udev");
+  if (udev_mon == NULL) BP(NULL);
+  udev_monitor_filter_add_match_subsystem_devtype(udev_mon, "input", NULL);
+  udev_monitor_enable_receiving(udev_mon);
+  input_thread_context.udev_monitor = udev_mon;
+  input_thread_context.udev_monitor_fd = udev_monitor_get_fd(udev_mon);
+  struct epoll_event udev_mon_event = {};
+  udev_mon_event.events = EPOLLIN;
+  udev_mon_event.data.fd = input_thread_context.udev_monitor_fd;
+  epoll_ctl(epoll_udev_fd, EPOLL_CTL_ADD, input_thread_context.udev_monitor_fd, 
+            &udev_mon_event);
+
+  udev_populate_devices(udev_obj, &input_thread_context);
+
+  pthread_t input_thread = {};
+  if (pthread_create(&input_thread, NULL, input_thread_proc, &input_thread_context) != 0) 
+  {
+    EBP(NULL);
+  }
 
 
   int pulse_samples_per_second = 44100;
@@ -1068,6 +1984,12 @@ main(int argc, char *argv[])
   int pulse_buffer_num_samples =  pulse_buffer_num_base_samples * pulse_num_channels;
   s16 *pulse_buffer = (s16 *)calloc(pulse_buffer_num_samples, sizeof(s16));
   if (pulse_buffer == NULL) EBP(NULL);
+  u64 pulse_num_samples_written = 0;
+#if defined(HHF_INTERNAL)
+  u32 pulse_frames_since_latency_query = PULSE_LATENCY_QUERY_FRAMES;
+  u64 pulse_latency_query_ns = 0;
+  u64 pulse_play_cursor_at_query = 0;
+#endif
 
   HHFSoundBuffer hhf_sound_buffer = {};
   hhf_sound_buffer.samples_per_second = pulse_samples_per_second;
@@ -1077,7 +1999,9 @@ main(int argc, char *argv[])
   HHFMemory hhf_memory = {};
   // TODO(Ryan): Allocate based on information from sysinfo()
   u64 hhf_permanent_size = MEGABYTES(64);
-  u64 hhf_transient_size = GIGABYTES(2);
+  // NOTE(Ryan): Copies of the back buffer are reserved at its largest size, so peak transient 
+  // use, shown by the F1 overlay, doesn't grow with resizing
+  u64 hhf_transient_size = MEGABYTES(256);
   u64 hhf_memory_raw_size = hhf_permanent_size + hhf_transient_size;
 #if defined(HHF_INTERNAL)
   void *hhf_memory_raw_base_addr = (void *)TERABYTES(2);
@@ -1095,7 +2019,7 @@ main(int argc, char *argv[])
                               -1, 0);
   if (hhf_memory_raw == MAP_FAILED) EBP(NULL);
 
-  memset(hhf_memory_raw, 0x00, hhf_memory_raw_size);
+  // NOTE(Ryan): Anonymous mappings are zeroed, so no memset (which would also commit every page)
 
   hhf_memory.permanent = (u8 *)hhf_memory_raw;
   hhf_memory.permanent_size = hhf_permanent_size;
@@ -1105,9 +2029,15 @@ main(int argc, char *argv[])
   HHFThreadContext hhf_thread_context = {};
 
   HHFPlatform hhf_platform = {};
-  hhf_platform.read_entire_file = hhf_platform_read_entire_file;
-  hhf_platform.free_read_file_result = hhf_platform_free_read_file_result;
   hhf_platform.write_entire_file = hhf_platform_write_entire_file;
+  hhf_platform.open_file = hhf_platform_open_file;
+  hhf_platform.close_file = hhf_platform_close_file;
+  hhf_platform.read_file_async = hhf_platform_read_file_async;
+  hhf_platform.poll_io = hhf_platform_poll_io;
+  hhf_platform.wait_io = hhf_platform_wait_io;
+  hhf_platform.map_file = hhf_platform_map_file;
+  hhf_platform.unmap_file = hhf_platform_unmap_file;
+  io_system_initialise(&global_io_system);
 
   // TODO(Ryan): Replace breakpoints with proper NULL and error handling
 
@@ -1121,43 +2051,80 @@ main(int argc, char *argv[])
   {
     if (*cursor == '/') last_slash = cursor;
   }
+  char hhf_build_loc[128] = {};
   char hhf_lib_loc[128] = {};
-  char hhf_temp_lib_loc[128] = {};
-  snprintf(hhf_lib_loc, sizeof(hhf_lib_loc), "%.*s/hhf.so", 
+  snprintf(hhf_build_loc, sizeof(hhf_build_loc), "%.*s", 
            (int)(last_slash - hhf_location), hhf_location);
-  snprintf(hhf_temp_lib_loc, sizeof(hhf_lib_loc), "%.*s/hhf.temp-so", 
+  snprintf(hhf_lib_loc, sizeof(hhf_lib_loc), "%.*s/hhf.so", 
            (int)(last_slash - hhf_location), hhf_location);
 
-  // IMPORTANT(Ryan): Signals utilised as it seems that the modification time of a file is
-  // changed before writing has completed. 
-  struct sigaction signal_reload_act = {};
-  signal_reload_act.sa_handler = signal_reload_update_and_render;
-  if (sigaction(SIGUSR1, &signal_reload_act, NULL) == -1) EBP(NULL);
-  void *update_and_render_lib = NULL;
+  HotReloadState hot_reload_state = {};
+  strcpy(hot_reload_state.lib_name, "hhf.so");
+  snprintf(hot_reload_state.temp_lib_locs[0], sizeof(hot_reload_state.temp_lib_locs[0]), 
+           "%.*s/hhf.temp-so.0", (int)(last_slash - hhf_location), hhf_location);
+  snprintf(hot_reload_state.temp_lib_locs[1], sizeof(hot_reload_state.temp_lib_locs[1]), 
+           "%.*s/hhf.temp-so.1", (int)(last_slash - hhf_location), hhf_location);
+
   hhf_update_and_render_t update_and_render = NULL;
+  void *update_and_render_lib = hot_reload_load_lib(&hot_reload_state, hhf_lib_loc, 
+                                                    &update_and_render);
+
+  // IMPORTANT(Ryan): Modification time changes before writing has completed, so only react 
+  // to a closed write or a rename into place, which misc/build does
+  hot_reload_state.inotify_fd = inotify_init1(IN_CLOEXEC);
+  if (hot_reload_state.inotify_fd == -1) EBP(NULL);
+  hot_reload_state.lib_watch_fd = inotify_add_watch(hot_reload_state.inotify_fd, hhf_build_loc, 
+                                                    IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (hot_reload_state.lib_watch_fd == -1) EBP(NULL);
+  // NOTE(Ryan): Assets are relative to the working directory
+  hot_reload_state.asset_watch_fd = inotify_add_watch(hot_reload_state.inotify_fd, "test", 
+                                                      IN_CLOSE_WRITE | IN_MOVED_TO);
+
+  HotReloadThreadContext hot_reload_thread_context = {};
+  hot_reload_thread_context.state = &hot_reload_state;
+  hot_reload_thread_context.lib_loc = hhf_lib_loc;
+  pthread_t hot_reload_thread = {};
+  if (pthread_create(&hot_reload_thread, NULL, hot_reload_thread_proc, 
+                     &hot_reload_thread_context) != 0) 
+  {
+    EBP(NULL);
+  }
 
 
   xrender_xpresent_back_buffer(xlib_display, xlib_window, xlib_gc,
                                xrandr_active_crtc.crtc, &xlib_back_buffer, 
-                               xlib_window_width, xlib_window_height);
+                               xlib_window_width, xlib_window_height, NULL, 0, 0);
 
 
   u64 prev_cycle_count = __rdtsc();
   struct timespec prev_timespec = {};
   clock_gettime(CLOCK_MONOTONIC_RAW, &prev_timespec);
 
+  // NOTE(Ryan): Wall clock time not yet simulated. Render once immediately with one tick 
+  struct timespec prev_sim_timespec = prev_timespec;
+  r32 sim_accumulator = hhf_cur_input.sim_dt;
+
   RecordingState recording_state = {};
-  recording_state.mem_size = hhf_memory.permanent_size + hhf_memory.transient_size;
+  // NOTE(Ryan): Transient memory only holds caches, which are keyed on generation counters 
+  // in permanent memory, so they revalidate themselves when permanent memory is restored
+  recording_state.mem_size = hhf_memory.permanent_size;
   recording_state.mem = malloc(recording_state.mem_size);
   recording_state.max_input_size = sizeof(HHFInput) * 60 * 10;
   recording_state.input = malloc(recording_state.max_input_size); 
   HHFInput *new_input = NULL;
 
+  FramePacer frame_pacer = {};
+  frame_pacer.vblank_period_ns = BILLION / xrandr_active_crtc.refresh_rate;
+#if defined(HHF_INTERNAL)
+  u32 num_reported_missed_frames = 0;
+#endif
+
   bool input_passed_to_hhf = false;
   while (want_to_run)
   {
     XEvent xlib_event = {};
-    while (XPending(xlib_display) > 0)
+    // NOTE(Ryan): First XNextEvent blocks, so we're idle until the next present completes
+    do
     {
       XNextEvent(xlib_display, &xlib_event);
 
@@ -1175,17 +2142,6 @@ main(int argc, char *argv[])
         break;
       }
 
-      // udev_check_hotplug_devices();
-
-      Window xlib_focused_window = 0;
-      int xlib_focused_window_state = 0;
-      XGetInputFocus(xlib_display, &xlib_focused_window, &xlib_focused_window_state);
-      if (xlib_focused_window == xlib_window)
-      {
-        udev_check_poll_devices(epoll_udev_fd, udev_poll_devices, &hhf_prev_input, 
-                                &hhf_cur_input, &xlib_info, &hhf_memory, &recording_state);
-      }
-
       if (xlib_event.type == GenericEvent)
       {
         XGenericEventCookie *cookie = (XGenericEventCookie *)&xlib_event.xcookie;
@@ -1194,18 +2150,51 @@ main(int argc, char *argv[])
           XGetEventData(xlib_display, cookie);
           if (cookie->evtype == PresentCompleteNotify)
           {
-            if (want_to_reload_update_and_render)
+            XPresentCompleteNotifyEvent *present_event = \
+              (XPresentCompleteNotifyEvent *)cookie->data;
+            frame_pacer_complete(&frame_pacer, present_event->ust, present_event->msc);
+            sleep_until_ns(frame_pacer_wake_ns(&frame_pacer));
+            u64 frame_start_ns = get_monotonic_ns();
+
+            // NOTE(Ryan): Consumed after sleeping, so the frame sees every event up to its start
+            Window xlib_focused_window = 0;
+            int xlib_focused_window_state = 0;
+            XGetInputFocus(xlib_display, &xlib_focused_window, &xlib_focused_window_state);
+            udev_process_input_events(input_event_queue, frame_start_ns, 
+                                      xlib_focused_window == xlib_window,
+                                      &hhf_prev_input, &hhf_cur_input, &xlib_info, 
+                                      &hhf_memory, &recording_state);
+
+            void *pending_lib = __atomic_load_n(&hot_reload_state.pending_lib, __ATOMIC_ACQUIRE);
+            if (pending_lib != NULL)
             {
-              if (update_and_render_lib != NULL) dlclose(update_and_render_lib);
-              copy_file(hhf_lib_loc, hhf_temp_lib_loc);
-              // TODO(Ryan): Understand how executables and shared objects exist in memory
-              update_and_render_lib = dlopen(hhf_temp_lib_loc, RTLD_NOW);
-              if (update_and_render_lib == NULL) EBP(NULL);
-              update_and_render = (hhf_update_and_render_t)dlsym(update_and_render_lib, "hhf_update_and_render");
-              if (update_and_render == NULL) EBP(dlerror());
-              want_to_reload_update_and_render = 0;
+              dlclose(update_and_render_lib);
+              update_and_render_lib = pending_lib;
+              update_and_render = hot_reload_state.pending_update_and_render;
+              __atomic_store_n(&hot_reload_state.pending_lib, NULL, __ATOMIC_RELEASE);
             }
+            hhf_memory.asset_generation = __atomic_load_n(&hot_reload_state.asset_generation, 
+                                                          __ATOMIC_ACQUIRE);
             
+            // NOTE(Ryan): Measured rather than assumed from the refresh rate, so missed vblanks 
+            // are caught up. Capped so a stall, e.g. a breakpoint, doesn't spiral
+            struct timespec sim_timespec = {};
+            clock_gettime(CLOCK_MONOTONIC_RAW, &sim_timespec);
+            sim_accumulator += timespec_diff(&prev_sim_timespec, &sim_timespec) / (r32)BILLION;
+            prev_sim_timespec = sim_timespec;
+
+            r32 sim_dt = hhf_cur_input.sim_dt;
+            int num_sim_ticks = (int)(sim_accumulator / sim_dt);
+            if (num_sim_ticks > HHF_MAX_SIM_TICKS_PER_FRAME)
+            {
+              num_sim_ticks = HHF_MAX_SIM_TICKS_PER_FRAME;
+              sim_accumulator = num_sim_ticks * sim_dt;
+            }
+            sim_accumulator -= num_sim_ticks * sim_dt;
+            hhf_cur_input.num_sim_ticks = num_sim_ticks;
+            hhf_cur_input.render_alpha = sim_accumulator / sim_dt;
+
+            // NOTE(Ryan): Tick counts are recorded too, so playback steps identically
             if (recording_state.are_recording)
             {
               record_input(&recording_state, &hhf_cur_input);
@@ -1217,6 +2206,11 @@ main(int argc, char *argv[])
                 recording_state.input_bytes_read = 0;
                 memcpy(hhf_memory.permanent, recording_state.mem, recording_state.mem_size);
               }
+              // NOTE(Ryan): Permanent memory was just restored, so cached screen contents are stale
+              if (recording_state.input_bytes_read == 0)
+              {
+                hhf_back_buffer.needs_full_redraw = true;
+              }
 
               new_input = (HHFInput *)((u8 *)recording_state.input + recording_state.input_bytes_read);
 
@@ -1235,35 +2229,82 @@ main(int argc, char *argv[])
 
             input_passed_to_hhf = true;
 
+#if defined(HHF_INTERNAL)
+            end_debug_cycle_counters(&hhf_memory);
+            // NOTE(Ryan): Only when another frame is missed, as printing every frame floods the 
+            // terminal
+            if (frame_pacer.num_missed_frames != num_reported_missed_frames)
+            {
+              printf("missed frames: %u, work estimate: %.02fms, vblank period: %.02fms\n", 
+                     frame_pacer.num_missed_frames, frame_pacer.work_estimate_ns / 1000000.0f,
+                     frame_pacer.vblank_period_ns / 1000000.0f);
+              num_reported_missed_frames = frame_pacer.num_missed_frames;
+            }
+#endif
+
             // TODO(Ryan): Add however long last frame took to audio minimum size
             if (pa_simple_write(pulse_player, pulse_buffer, sizeof(s16) * 2 * pulse_buffer_num_base_samples, 
                                 &pulse_error_code) < 0) BP(pa_strerror(pulse_error_code));
+            pulse_num_samples_written += pulse_buffer_num_base_samples;
 
-            /*#if defined(HHF_INTERNAL)
+#if defined(HHF_INTERNAL)
+            // NOTE(Ryan): Pulse doesn't expose a play cursor, so derive it from how far behind 
+            // the written samples playback is
+            if (pulse_frames_since_latency_query >= PULSE_LATENCY_QUERY_FRAMES)
             {
-              int pad_x = 16, pad_y = 16;
-              int x0 = pad_x, x1 = width - pad_x;
-              int pos[30] = {}; // store 30 most recent
-              if (index > 30) index = 0;
-              debug_display_buffer()
+              pa_usec_t pulse_latency_us = pa_simple_get_latency(pulse_player, &pulse_error_code);
+              if (pulse_latency_us != (pa_usec_t)-1)
               {
-                // Assume length of buffer is same as width of back buffer
+                u64 pulse_latency_samples = (pulse_latency_us * pulse_samples_per_second) / 1000000;
+                pulse_play_cursor_at_query = 0;
+                if (pulse_latency_samples < pulse_num_samples_written)
+                {
+                  pulse_play_cursor_at_query = pulse_num_samples_written - pulse_latency_samples;
+                }
+                pulse_latency_query_ns = get_monotonic_ns();
               }
+              pulse_frames_since_latency_query = 0;
             }
-            #endif*/
+            pulse_frames_since_latency_query++;
+
+            u64 pulse_play_cursor = 0;
+            if (pulse_latency_query_ns != 0)
+            {
+              u64 pulse_samples_played = ((get_monotonic_ns() - pulse_latency_query_ns) * 
+                                          pulse_samples_per_second) / BILLION;
+              pulse_play_cursor = MIN(pulse_play_cursor_at_query + pulse_samples_played, 
+                                      pulse_num_samples_written);
+            }
+#endif
 
             xrender_xpresent_back_buffer(xlib_display, xlib_window, xlib_gc,
                                          xrandr_active_crtc.crtc, &xlib_back_buffer,
-                                         xlib_info.window_width, xlib_info.window_height);
+                                         xlib_info.window_width, xlib_info.window_height,
+                                         hhf_back_buffer.dirty_rects, 
+                                         hhf_back_buffer.num_dirty_rects,
+                                         frame_pacer.target_msc);
+            XFlush(xlib_display);
+            frame_pacer_record_work(&frame_pacer, get_monotonic_ns() - frame_start_ns);
             
             u64 end_cycle_count = __rdtsc();
             struct timespec end_timespec = {};
             clock_gettime(CLOCK_MONOTONIC_RAW, &end_timespec);
             r32 ms_per_frame = timespec_diff(&prev_timespec, &end_timespec) / 1000000.0f;
 
-            char ms_per_frame_buf[16] = {};
-            snprintf(ms_per_frame_buf, 16, "%.02f", ms_per_frame); 
-            XStoreName(xlib_display, xlib_window, ms_per_frame_buf);
+#if defined(HHF_INTERNAL)
+            hhf_memory.debug_ms_per_frame = ms_per_frame;
+            hhf_memory.debug_target_ms_per_frame = frame_pacer.vblank_period_ns / 1000000.0f;
+            hhf_memory.debug_work_estimate_ms = frame_pacer.work_estimate_ns / 1000000.0f;
+            hhf_memory.debug_num_missed_frames = frame_pacer.num_missed_frames;
+
+            HHFDebugFrameMarker *frame_marker = \
+              &hhf_memory.debug_frame_markers[hhf_memory.debug_frame_marker_i];
+            frame_marker->ms_per_frame = ms_per_frame;
+            frame_marker->audio_play_cursor = pulse_play_cursor;
+            frame_marker->audio_write_cursor = pulse_num_samples_written;
+            hhf_memory.debug_frame_marker_i = \
+              (hhf_memory.debug_frame_marker_i + 1) % HHF_DEBUG_NUM_FRAME_MARKERS;
+#endif
             //printf("ms per frame: %.02f\n", ms_per_frame); 
             //printf("mega cycles per frame: %.02f\n", (r64)(end_cycle_count - prev_cycle_count) / 1000000.0f); 
 
@@ -1280,7 +2321,7 @@ main(int argc, char *argv[])
       if (input_passed_to_hhf)
       {
         hhf_cur_input = {};
-        hhf_cur_input.frame_dt = hhf_prev_input.frame_dt;
+        hhf_cur_input.sim_dt = hhf_prev_input.sim_dt;
         hhf_cur_input.mouse_x = hhf_prev_input.mouse_x; 
         hhf_cur_input.mouse_y = hhf_prev_input.mouse_y;
         for (int controller_i = 0; controller_i < HHF_INPUT_MAX_NUM_CONTROLLERS; controller_i++)
@@ -1300,7 +2341,7 @@ main(int argc, char *argv[])
         input_passed_to_hhf = false;
       }
 
-    } 
+    } while (XPending(xlib_display) > 0);
 
   }
 